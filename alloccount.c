@@ -0,0 +1,39 @@
+#include "alloccount.h"
+
+#include <stdlib.h>
+
+static SDL_atomic_t sdl_allocs;
+
+static void* alloccount_sdl_malloc(size_t size) {
+    SDL_AtomicAdd(&sdl_allocs, 1);
+    return malloc(size);
+}
+
+static void* alloccount_sdl_calloc(size_t count, size_t size) {
+    SDL_AtomicAdd(&sdl_allocs, 1);
+    return calloc(count, size);
+}
+
+static void* alloccount_sdl_realloc(void* ptr, size_t size) {
+    SDL_AtomicAdd(&sdl_allocs, 1);
+    return realloc(ptr, size);
+}
+
+void alloccount_install_sdl(void) {
+    SDL_SetMemoryFunctions(alloccount_sdl_malloc, alloccount_sdl_calloc, alloccount_sdl_realloc, free);
+}
+
+unsigned long alloccount_sdl(void) {
+    return (unsigned int) SDL_AtomicGet(&sdl_allocs);
+}
+
+// Same as the allocator of luaL_newstate, plus the count
+void* alloccount_lua(void* ud, void* ptr, size_t osize, size_t nsize) {
+    if (nsize == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    (*(unsigned long*) ud)++;
+    return realloc(ptr, nsize);
+}
@@ -0,0 +1,21 @@
+#ifndef ALLOCCOUNT_H
+#define ALLOCCOUNT_H
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+// Allocation accounting, to check that the frame loop doesn't allocate once warmed up.
+// Allocations are blocks obtained or resized, frees don't count.
+
+// Routes the allocations made by SDL through counting wrappers.
+// Has to be called before any other SDL function.
+void alloccount_install_sdl(void);
+
+// Allocations made by SDL so far, from any thread
+unsigned long alloccount_sdl(void);
+
+// lua_Alloc counting into the unsigned long pointed to by ud, see lua_setallocf
+void* alloccount_lua(void* ud, void* ptr, size_t osize, size_t nsize);
+
+#endif
@@ -0,0 +1,563 @@
+#include "audio.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define AUDIO_MASTER_VOLUME (1.0f / AUDIO_CHANNELS) // all channels at full volume don't clip
+
+// Phase increment of a note in semitones, 69 being A 440 Hz
+static Uint32 audio_step(double note, int wave) {
+    double frequency = 440 * SDL_pow(2, (note - 69) / 12);
+    if (wave == AUDIO_NOISE) {
+        frequency *= AUDIO_NOISE_SPEEDUP;
+    }
+    if (frequency > AUDIO_SAMPLE_RATE / 2) {
+        frequency = AUDIO_SAMPLE_RATE / 2;
+    }
+    return (Uint32) (frequency / AUDIO_SAMPLE_RATE * 4294967296.0);
+}
+
+Audio* audio_new(void) {
+    Audio* audio = malloc(sizeof(Audio));
+    memset(audio, 0, sizeof(Audio));
+
+    for (int i = 0; i < AUDIO_CHANNELS; i++) {
+        audio->envelopes[i].sustain = 1;
+        audio->channels[i].noise = 1;
+    }
+
+    // one period of each wave, in [-1, 1]
+    int size = 1 << AUDIO_WAVETABLE_BITS;
+    for (int i = 0; i < size; i++) {
+        audio->wavetables[AUDIO_SQUARE][i] = i < size / 2 ? 1.0f : -1.0f;
+        audio->wavetables[AUDIO_TRIANGLE][i] = (i < size / 2 ? i : size - i) * 4.0f / size - 1.0f;
+        audio->wavetables[AUDIO_SAW][i] = i * 2.0f / size - 1.0f;
+    }
+
+    for (int note = 0; note < AUDIO_NOTES; note++) {
+        audio->note_steps[0][note] = audio_step(note, AUDIO_SQUARE);
+        audio->note_steps[1][note] = audio_step(note, AUDIO_NOISE);
+    }
+
+    return audio;
+}
+
+int audio_post(Audio* audio, const AudioEvent* event) {
+    int head = SDL_AtomicGet(&audio->head);
+
+    if (head - SDL_AtomicGet(&audio->tail) >= AUDIO_QUEUE_SIZE) {
+        audio->dropped++;
+        return 0;
+    }
+
+    audio->events[head & (AUDIO_QUEUE_SIZE - 1)] = *event;
+
+    // the event has to be complete before the callback can see the new head
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&audio->head, head + 1);
+    audio->posted++;
+
+    return 1;
+}
+
+void audio_reset(Audio* audio) {
+    AudioEvent event;
+    memset(&event, 0, sizeof(AudioEvent));
+    event.type = AUDIO_EVENT_RESET;
+    audio_post(audio, &event);
+
+    for (int i = 0; i < AUDIO_CHANNELS; i++) {
+        memset(&audio->envelopes[i], 0, sizeof(AudioEnvelope));
+        audio->envelopes[i].sustain = 1;
+    }
+}
+
+// Moves the envelope of a channel to stage, with the slope that reaches the next level in samples
+static void audio_enter(AudioChannel* channel, AudioStage stage, float target, Uint32 samples) {
+    channel->stage = stage;
+    channel->slope = samples > 0 ? (target - channel->level) / samples : target - channel->level;
+}
+
+static void audio_release(AudioChannel* channel) {
+    if (channel->stage != AUDIO_OFF) {
+        audio_enter(channel, AUDIO_RELEASE, 0, channel->envelope.release);
+    }
+}
+
+// The phase and level carry on from the previous note, so notes follow each other without a click
+static void audio_note(AudioChannel* channel, int wave, Uint32 step, float volume, Uint32 length, const AudioEnvelope* envelope) {
+    channel->wave = wave;
+    channel->step = step;
+    channel->volume = volume;
+    channel->envelope = *envelope;
+    channel->remaining = length;
+    audio_enter(channel, AUDIO_ATTACK, 1, envelope->attack);
+}
+
+// Plays the next row of the track of a channel and schedules the one after
+static void audio_next_row(Audio* audio, AudioChannel* channel) {
+    const AudioPattern* pattern = &audio->patterns[channel->track[channel->position]];
+
+    // an empty pattern would never let the time move on
+    if (pattern->count == 0 || pattern->length < (1 << AUDIO_ROW_FRACTION_BITS)) {
+        channel->track_count = 0;
+        audio_release(channel);
+        return;
+    }
+
+    Uint32 length = pattern->length + channel->fraction;
+    channel->countdown = length >> AUDIO_ROW_FRACTION_BITS;
+    channel->fraction = length & ((1 << AUDIO_ROW_FRACTION_BITS) - 1);
+
+    Uint8 note = pattern->notes[channel->row];
+    if (note > 0) {
+        audio_note(channel, pattern->wave, audio->note_steps[pattern->wave == AUDIO_NOISE][note],
+            pattern->volume, channel->countdown, &channel->track_envelope);
+    } else {
+        audio_release(channel);
+    }
+
+    if (++channel->row >= pattern->count) {
+        channel->row = 0;
+        if (++channel->position >= channel->track_count) {
+            channel->position = 0;
+            if (!channel->loop) {
+                // the last note still plays out
+                channel->track_count = 0;
+            }
+        }
+    }
+}
+
+// Applies the events posted since the last buffer
+static void audio_receive(Audio* audio) {
+    int tail = SDL_AtomicGet(&audio->tail);
+    int head = SDL_AtomicGet(&audio->head);
+    SDL_MemoryBarrierAcquire();
+
+    for (; tail != head; tail++) {
+        const AudioEvent* event = &audio->events[tail & (AUDIO_QUEUE_SIZE - 1)];
+        AudioChannel* channel = &audio->channels[event->channel];
+
+        switch (event->type) {
+            case AUDIO_EVENT_PLAY:
+                audio_note(channel, event->wave, event->step, event->volume, event->length, &event->envelope);
+                break;
+            case AUDIO_EVENT_STOP:
+                channel->track_count = 0;
+                audio_release(channel);
+                break;
+            case AUDIO_EVENT_PATTERN: {
+                AudioPattern* pattern = &audio->patterns[event->id];
+                pattern->wave = event->wave;
+                pattern->volume = event->volume;
+                pattern->length = event->length;
+                pattern->count = event->count;
+                memcpy(pattern->notes, event->data, event->count);
+                break;
+            }
+            case AUDIO_EVENT_TRACK:
+                // every track started by the same frame starts on the first sample of the next buffer
+                memcpy(channel->track, event->data, event->count);
+                channel->track_count = event->count;
+                channel->loop = event->loop;
+                channel->position = 0;
+                channel->row = 0;
+                channel->track_envelope = event->envelope;
+                channel->countdown = 0;
+                channel->fraction = 0;
+                break;
+            case AUDIO_EVENT_RESET:
+                for (int i = 0; i < AUDIO_CHANNELS; i++) {
+                    audio->channels[i].track_count = 0;
+                    audio_release(&audio->channels[i]);
+                }
+                memset(audio->patterns, 0, sizeof(audio->patterns));
+                break;
+        }
+    }
+
+    SDL_AtomicSet(&audio->tail, tail);
+}
+
+// Writes count samples of a channel to out
+static void audio_render(Audio* audio, AudioChannel* channel, float* out, int count) {
+    const float* wavetable = audio->wavetables[channel->wave < AUDIO_NOISE ? channel->wave : 0];
+    int i = 0;
+
+    for (; i < count && channel->stage != AUDIO_OFF; i++) {
+        float value = channel->wave == AUDIO_NOISE
+            ? (channel->noise & 1 ? 1.0f : -1.0f)
+            : wavetable[channel->phase >> (32 - AUDIO_WAVETABLE_BITS)];
+        out[i] = value * channel->level * channel->volume;
+
+        Uint32 phase = channel->phase + channel->step;
+        if (phase < channel->phase && channel->wave == AUDIO_NOISE) {
+            // 15-bit LFSR, taps 14 and 15
+            channel->noise = (channel->noise >> 1) | ((((channel->noise >> 1) ^ channel->noise) & 1) << 14);
+        }
+        channel->phase = phase;
+
+        channel->level += channel->slope;
+        switch (channel->stage) {
+            case AUDIO_ATTACK:
+                if (channel->level >= 1) {
+                    channel->level = 1;
+                    audio_enter(channel, AUDIO_DECAY, channel->envelope.sustain, channel->envelope.decay);
+                }
+                break;
+            case AUDIO_DECAY:
+                if (channel->level <= channel->envelope.sustain) {
+                    channel->level = channel->envelope.sustain;
+                    channel->stage = AUDIO_SUSTAIN;
+                    channel->slope = 0;
+                }
+                break;
+            case AUDIO_RELEASE:
+                if (channel->level <= 0) {
+                    channel->level = 0;
+                    channel->stage = AUDIO_OFF;
+                }
+                break;
+            default:
+                break;
+        }
+
+        if (channel->remaining > 0 && --channel->remaining == 0) {
+            audio_release(channel);
+        }
+    }
+
+    memset(out + i, 0, (count - i) * sizeof(float));
+}
+
+// Renders count samples of a channel, starting the rows of its track on the sample they are due
+static void audio_sequence(Audio* audio, AudioChannel* channel, float* out, int count) {
+    int done = 0;
+
+    while (done < count) {
+        if (channel->track_count > 0 && channel->countdown == 0) {
+            audio_next_row(audio, channel);
+        }
+
+        int n = count - done;
+        if (channel->track_count > 0 && channel->countdown < (Uint32) n) {
+            n = channel->countdown;
+        }
+
+        audio_render(audio, channel, out + done, n);
+        channel->countdown = channel->countdown > (Uint32) n ? channel->countdown - n : 0;
+        done += n;
+    }
+}
+
+// Sums the channels into 16-bit samples, saturating
+static void audio_mix(Audio* audio, Sint16* out, int count) {
+    const float scale = AUDIO_MASTER_VOLUME * 32767;
+    int i = 0;
+
+#ifdef __SSE2__
+    const __m128 scale4 = _mm_set1_ps(scale);
+    for (; i + 8 <= count; i += 8) {
+        __m128 low = _mm_loadu_ps(&audio->mix[0][i]);
+        __m128 high = _mm_loadu_ps(&audio->mix[0][i + 4]);
+        for (int c = 1; c < AUDIO_CHANNELS; c++) {
+            low = _mm_add_ps(low, _mm_loadu_ps(&audio->mix[c][i]));
+            high = _mm_add_ps(high, _mm_loadu_ps(&audio->mix[c][i + 4]));
+        }
+
+        // rounded to the nearest integer, then packed with signed saturation
+        __m128i low32 = _mm_cvtps_epi32(_mm_mul_ps(low, scale4));
+        __m128i high32 = _mm_cvtps_epi32(_mm_mul_ps(high, scale4));
+        _mm_storeu_si128((__m128i*) (out + i), _mm_packs_epi32(low32, high32));
+    }
+#endif
+
+    // what's left, or everything without SSE2
+    for (; i < count; i++) {
+        float sample = 0;
+        for (int c = 0; c < AUDIO_CHANNELS; c++) {
+            sample += audio->mix[c][i];
+        }
+        sample *= scale;
+        sample = sample > 32767 ? 32767 : sample < -32768 ? -32768 : sample;
+        out[i] = (Sint16) (sample < 0 ? sample - 0.5f : sample + 0.5f);
+    }
+}
+
+static void audio_callback(void* userdata, Uint8* stream, int length) {
+    Audio* audio = userdata;
+    Sint16* out = (Sint16*) stream;
+    int frames = length / sizeof(Sint16);
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    audio_receive(audio);
+
+    while (frames > 0) {
+        int count = frames < AUDIO_MIX_FRAMES ? frames : AUDIO_MIX_FRAMES;
+
+        for (int i = 0; i < AUDIO_CHANNELS; i++) {
+            audio_sequence(audio, &audio->channels[i], audio->mix[i], count);
+        }
+        audio_mix(audio, out, count);
+
+        out += count;
+        frames -= count;
+    }
+
+    audio->buffers++;
+    audio->mix_ticks += SDL_GetPerformanceCounter() - start;
+}
+
+int audio_start(Audio* audio) {
+    if (SDL_WasInit(SDL_INIT_AUDIO) == 0 && SDL_InitSubSystem(SDL_INIT_AUDIO) < 0) {
+        printf("! Audio: couldn't initialize SDL audio: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    SDL_AudioSpec want;
+    memset(&want, 0, sizeof(SDL_AudioSpec));
+    want.freq = AUDIO_SAMPLE_RATE;
+    want.format = AUDIO_S16SYS;
+    want.channels = 1;
+    want.samples = AUDIO_BUFFER_FRAMES;
+    want.callback = audio_callback;
+    want.userdata = audio;
+
+    // no changes allowed, SDL converts to whatever the device wants
+    if ((audio->device = SDL_OpenAudioDevice(NULL, 0, &want, NULL, 0)) == 0) {
+        printf("! Audio: couldn't open a device: %s\n", SDL_GetError());
+        return 0;
+    }
+
+    SDL_PauseAudioDevice(audio->device, 0);
+    return 1;
+}
+
+void audio_free(Audio* audio) {
+    if (audio == NULL) {
+        return;
+    }
+
+    if (audio->device != 0) {
+        SDL_CloseAudioDevice(audio->device);
+        printf("Audio: %lu events, %lu dropped, %lu buffers mixed in %.1f us on average (%s driver)\n",
+            audio->posted, audio->dropped, audio->buffers,
+            audio->buffers > 0 ? (double) audio->mix_ticks * 1000000 / SDL_GetPerformanceFrequency() / audio->buffers : 0.0,
+            SDL_GetCurrentAudioDriver());
+    }
+
+    free(audio);
+}
+
+static Audio* lib_audio(lua_State* L) {
+    return lua_touserdata(L, lua_upvalueindex(1));
+}
+
+static int lib_audio_channel(lua_State* L, int arg) {
+    lua_Integer channel = luaL_checkinteger(L, arg);
+
+    if (channel < 0 || channel >= AUDIO_CHANNELS) {
+        luaL_error(L, "Audio error: channel %d does not exist", (int) channel);
+    }
+
+    return channel;
+}
+
+static Uint32 lib_audio_samples(lua_State* L, int arg) {
+    lua_Number samples = luaL_optnumber(L, arg, 0) * AUDIO_SAMPLE_RATE / 1000;
+    // NaN fails the first test, anything past the range of Uint32 plays as long as it can
+    if (!(samples > 0)) {
+        return 0;
+    }
+    return samples < 4294967295.0 ? (Uint32) samples : 0xFFFFFFFF;
+}
+
+// play(channel, wave, note, [volume], [ms]): note in semitones, 69 is A 440 Hz and fractions
+// bend the pitch. Plays until stop(channel) or for ms milliseconds, through the envelope
+// of the channel.
+static int lib_audio_play(lua_State* L) {
+    Audio* audio = lib_audio(L);
+    AudioEvent event;
+    memset(&event, 0, sizeof(AudioEvent));
+
+    event.type = AUDIO_EVENT_PLAY;
+    event.channel = lib_audio_channel(L, 1);
+
+    lua_Integer wave = luaL_checkinteger(L, 2);
+    if (wave < 0 || wave >= AUDIO_WAVE_COUNT) {
+        return luaL_error(L, "Audio error: wave %d does not exist", (int) wave);
+    }
+    event.wave = wave;
+
+    // audio_step converts to an integer, which a NaN or infinite note can't become
+    lua_Number note = luaL_checknumber(L, 3);
+    if (!(note >= 0 && note < AUDIO_NOTES)) {
+        return luaL_error(L, "Audio error: note %f is out of [0, %d)", note, AUDIO_NOTES);
+    }
+    event.step = audio_step(note, wave);
+
+    lua_Number volume = luaL_optnumber(L, 4, 1);
+    event.volume = volume < 0 ? 0 : volume > 1 ? 1 : volume;
+    event.length = lib_audio_samples(L, 5);
+
+    if (audio != NULL) {
+        event.envelope = audio->envelopes[event.channel];
+        audio_post(audio, &event);
+    }
+    return 0;
+}
+
+// stop(channel): stops the track of the channel and releases its note. stop() stops every channel.
+static int lib_audio_stop(lua_State* L) {
+    Audio* audio = lib_audio(L);
+    AudioEvent event;
+    memset(&event, 0, sizeof(AudioEvent));
+    event.type = AUDIO_EVENT_STOP;
+
+    int first = lua_isnoneornil(L, 1) ? 0 : lib_audio_channel(L, 1);
+    int last = lua_isnoneornil(L, 1) ? AUDIO_CHANNELS - 1 : first;
+
+    for (int i = first; audio != NULL && i <= last; i++) {
+        event.channel = i;
+        audio_post(audio, &event);
+    }
+    return 0;
+}
+
+// envelope(channel, attack_ms, decay_ms, sustain, release_ms): shape of the next notes of
+// the channel, sustain being a level in [0, 1]. Notes start as envelope(channel, 0, 0, 1, 0).
+static int lib_audio_envelope(lua_State* L) {
+    Audio* audio = lib_audio(L);
+    int channel = lib_audio_channel(L, 1);
+    AudioEnvelope envelope;
+
+    envelope.attack = lib_audio_samples(L, 2);
+    envelope.decay = lib_audio_samples(L, 3);
+    lua_Number sustain = luaL_optnumber(L, 4, 1);
+    envelope.sustain = sustain < 0 ? 0 : sustain > 1 ? 1 : sustain;
+    envelope.release = lib_audio_samples(L, 5);
+
+    if (audio != NULL) {
+        audio->envelopes[channel] = envelope;
+    }
+    return 0;
+}
+
+// Reads the integers of the table in argument arg, each in [0, max)
+static int lib_audio_bytes(lua_State* L, int arg, Uint8* bytes, int capacity, int max, const char* what) {
+    luaL_checktype(L, arg, LUA_TTABLE);
+    lua_Integer count = luaL_len(L, arg);
+
+    if (count > capacity) {
+        return luaL_error(L, "Audio error: more than %d %ss", capacity, what);
+    }
+
+    for (int i = 0; i < count; i++) {
+        lua_geti(L, arg, i + 1);
+        int valid;
+        lua_Integer value = lua_tointegerx(L, -1, &valid);
+        lua_pop(L, 1);
+
+        if (!valid || value < 0 || value >= max) {
+            return luaL_error(L, "Audio error: %s %d is out of range", what, i + 1);
+        }
+        bytes[i] = value;
+    }
+
+    return count;
+}
+
+// pattern(id, row_ms, notes, [wave], [volume]): defines pattern id (0 to 63) as a list of up
+// to 32 notes, one every row_ms milliseconds, 0 being a rest. Redefining a pattern that is
+// playing takes effect from its next row.
+static int lib_audio_pattern(lua_State* L) {
+    Audio* audio = lib_audio(L);
+    AudioEvent event;
+    memset(&event, 0, sizeof(AudioEvent));
+    event.type = AUDIO_EVENT_PATTERN;
+
+    lua_Integer id = luaL_checkinteger(L, 1);
+    if (id < 0 || id >= AUDIO_PATTERNS) {
+        return luaL_error(L, "Audio error: pattern %d does not exist", (int) id);
+    }
+    event.id = id;
+
+    lua_Number row_ms = luaL_checknumber(L, 2);
+    lua_Number samples = row_ms * AUDIO_SAMPLE_RATE / 1000;
+    if (!(samples >= 1 && samples < 1 << (32 - AUDIO_ROW_FRACTION_BITS))) {
+        return luaL_error(L, "Audio error: rows of pattern %d can't last %f ms", (int) id, row_ms);
+    }
+    event.length = (Uint32) (samples * (1 << AUDIO_ROW_FRACTION_BITS));
+
+    event.count = lib_audio_bytes(L, 3, event.data, AUDIO_PATTERN_ROWS, AUDIO_NOTES, "note");
+
+    lua_Integer wave = luaL_optinteger(L, 4, AUDIO_SQUARE);
+    if (wave < 0 || wave >= AUDIO_WAVE_COUNT) {
+        return luaL_error(L, "Audio error: wave %d does not exist", (int) wave);
+    }
+    event.wave = wave;
+
+    lua_Number volume = luaL_optnumber(L, 5, 1);
+    event.volume = volume < 0 ? 0 : volume > 1 ? 1 : volume;
+
+    if (audio != NULL) {
+        audio_post(audio, &event);
+    }
+    return 0;
+}
+
+// track(channel, patterns, [loop]): plays up to 16 patterns one after another on the channel,
+// through its envelope, over and over unless loop is false. Tracks started during the same
+// frame start on the same sample. track(channel) stops the track.
+static int lib_audio_track(lua_State* L) {
+    Audio* audio = lib_audio(L);
+    AudioEvent event;
+    memset(&event, 0, sizeof(AudioEvent));
+
+    event.channel = lib_audio_channel(L, 1);
+    if (lua_isnoneornil(L, 2)) {
+        event.type = AUDIO_EVENT_STOP;
+    } else {
+        event.type = AUDIO_EVENT_TRACK;
+        event.count = lib_audio_bytes(L, 2, event.data, AUDIO_TRACK_PATTERNS, AUDIO_PATTERNS, "pattern");
+        event.loop = lua_isnoneornil(L, 3) || lua_toboolean(L, 3);
+        if (event.count == 0) {
+            event.type = AUDIO_EVENT_STOP;
+        }
+    }
+
+    if (audio != NULL) {
+        event.envelope = audio->envelopes[event.channel];
+        audio_post(audio, &event);
+    }
+    return 0;
+}
+
+static const luaL_Reg AudioLib[] = {
+    {"play", lib_audio_play},
+    {"stop", lib_audio_stop},
+    {"envelope", lib_audio_envelope},
+    {"pattern", lib_audio_pattern},
+    {"track", lib_audio_track},
+    {NULL, NULL}
+};
+
+void audio_openlib(lua_State* L, Audio* audio) {
+    lua_newtable(L);
+    lua_pushlightuserdata(L, audio);
+    luaL_setfuncs(L, AudioLib, 1);
+
+    const char* waves[AUDIO_WAVE_COUNT] = {"SQUARE", "TRIANGLE", "SAW", "NOISE"};
+    for (int i = 0; i < AUDIO_WAVE_COUNT; i++) {
+        lua_pushinteger(L, i);
+        lua_setfield(L, -2, waves[i]);
+    }
+
+    lua_setglobal(L, "NibbleAudio");
+}
@@ -0,0 +1,155 @@
+#ifndef AUDIO_H
+#define AUDIO_H
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "SDL.h"
+
+#define AUDIO_CHANNELS 4
+#define AUDIO_SAMPLE_RATE 44100
+#define AUDIO_BUFFER_FRAMES 512 // samples per callback, about 12 ms
+#define AUDIO_MIX_FRAMES 256 // samples mixed at a time
+#define AUDIO_QUEUE_SIZE 256 // events, a power of two
+#define AUDIO_NOISE_SPEEDUP 16 // noise changes value this many times per period of its note
+#define AUDIO_WAVETABLE_BITS 10 // a period of the square, triangle and saw waves is 1024 samples
+#define AUDIO_NOTES 128 // pattern notes, 1 to 127, 0 being a rest
+#define AUDIO_PATTERNS 64
+#define AUDIO_PATTERN_ROWS 32
+#define AUDIO_TRACK_PATTERNS 16 // patterns a track plays one after another
+#define AUDIO_ROW_FRACTION_BITS 8 // rows last a fixed point number of samples, so tempos don't drift apart
+
+typedef enum AudioWave {
+    AUDIO_SQUARE,
+    AUDIO_TRIANGLE,
+    AUDIO_SAW,
+    AUDIO_NOISE,
+    AUDIO_WAVE_COUNT
+} AudioWave;
+
+// Attack, decay and release in samples, the sustain level in [0, 1]
+typedef struct AudioEnvelope {
+    Uint32 attack;
+    Uint32 decay;
+    float sustain;
+    Uint32 release;
+} AudioEnvelope;
+
+typedef enum AudioEventType {
+    AUDIO_EVENT_PLAY,
+    AUDIO_EVENT_STOP, // stops the track of the channel and starts the release of its note
+    AUDIO_EVENT_PATTERN, // defines a pattern
+    AUDIO_EVENT_TRACK, // starts playing a list of patterns on a channel
+    AUDIO_EVENT_RESET // stops every channel and forgets the patterns
+} AudioEventType;
+
+// What the cart asks of the mixer, carried from the cart thread to the audio thread
+typedef struct AudioEvent {
+    Uint8 type;
+    Uint8 channel; // PLAY, STOP and TRACK
+    Uint8 wave; // PLAY and PATTERN
+    Uint8 id; // PATTERN
+    Uint8 loop; // TRACK
+    Uint8 count; // notes of a PATTERN, patterns of a TRACK
+    Uint32 step; // PLAY: phase increment per sample, the phase wraps around at 2^32
+    float volume; // PLAY and PATTERN
+    Uint32 length; // PLAY: samples before the release starts, 0 = until stopped. PATTERN: row length
+    AudioEnvelope envelope; // PLAY and TRACK
+    Uint8 data[AUDIO_PATTERN_ROWS]; // notes of a PATTERN, pattern ids of a TRACK
+} AudioEvent;
+
+// Rows of notes played one after another on the channel of the track playing it
+typedef struct AudioPattern {
+    Uint8 wave;
+    float volume;
+    Uint32 length; // of a row, in samples with AUDIO_ROW_FRACTION_BITS fraction bits
+    Uint8 count;
+    Uint8 notes[AUDIO_PATTERN_ROWS]; // 0 = rest
+} AudioPattern;
+
+typedef enum AudioStage {
+    AUDIO_OFF,
+    AUDIO_ATTACK,
+    AUDIO_DECAY,
+    AUDIO_SUSTAIN,
+    AUDIO_RELEASE
+} AudioStage;
+
+// Oscillator and envelope of a channel, only touched by the audio thread
+typedef struct AudioChannel {
+    Uint8 wave;
+    Uint32 phase;
+    Uint32 step;
+    float volume;
+    AudioEnvelope envelope;
+    AudioStage stage;
+    float level; // of the envelope
+    float slope; // added to level every sample in the current stage
+    Uint32 remaining; // samples before the release, 0 = until stopped
+    Uint16 noise; // linear feedback shift register
+
+    // track, when one is playing
+    Uint8 track[AUDIO_TRACK_PATTERNS];
+    Uint8 track_count; // 0 = no track
+    Uint8 loop;
+    Uint8 position; // in track
+    Uint8 row; // next row of the pattern
+    AudioEnvelope track_envelope;
+    Uint32 countdown; // samples before the next row
+    Uint32 fraction; // of a sample, carried over to the next row
+} AudioChannel;
+
+// A few channels of oscillators with envelopes, played by the SDL audio callback.
+// The cart posts events to a lock-free ring with a single producer, the thread running the
+// cart, and a single consumer, the callback. The callback takes no lock and allocates nothing.
+//
+// Channels can also play tracks: lists of patterns of notes, sequenced by the callback itself
+// so rows start on the exact sample whatever the frame rate. Oscillators read precomputed
+// wavetables, and the channels are summed and converted to 16 bits with SSE2 where available.
+typedef struct Audio {
+    SDL_AudioDeviceID device; // 0 until audio_start succeeded
+
+    AudioEvent events[AUDIO_QUEUE_SIZE];
+    SDL_atomic_t head; // next event to write, only moved by the producer
+    SDL_atomic_t tail; // next event to read, only moved by the consumer
+
+    // cart side
+    AudioEnvelope envelopes[AUDIO_CHANNELS]; // given to the next notes of each channel
+    unsigned long posted;
+    unsigned long dropped; // ring full
+
+    // read-only once built by audio_new
+    float wavetables[AUDIO_NOISE][1 << AUDIO_WAVETABLE_BITS];
+    Uint32 note_steps[2][AUDIO_NOTES]; // phase increment of each note, for tones then noise
+
+    // audio thread side
+    AudioChannel channels[AUDIO_CHANNELS];
+    AudioPattern patterns[AUDIO_PATTERNS];
+    float mix[AUDIO_CHANNELS][AUDIO_MIX_FRAMES]; // samples of each channel, summed by audio_mix
+    unsigned long buffers;
+    Uint64 mix_ticks;
+} Audio;
+
+// Events can be posted right away, they play once the device is started
+Audio* audio_new(void);
+
+// Opens the default audio device and starts playing. Returns 0 if there is no device,
+// e.g. on a machine without sound: use SDL_AUDIODRIVER=dummy or disk there.
+int audio_start(Audio* audio);
+
+// From the thread running the cart only. Returns 0 if the ring is full and the event was dropped.
+int audio_post(Audio* audio, const AudioEvent* event);
+
+// Back to the silence of audio_new for the next cart: notes and tracks stop, patterns and
+// envelopes are forgotten. From the thread running the cart only.
+void audio_reset(Audio* audio);
+
+// Registers play, stop, envelope, pattern and track as the NibbleAudio global, bound to audio.
+// With a NULL audio the calls are checked but play nothing.
+void audio_openlib(lua_State* L, Audio* audio);
+
+// Stops the device and prints the usage of the mixer
+void audio_free(Audio* audio);
+
+#endif
@@ -0,0 +1,33 @@
+-- Benchmark: memory map access, a tiled background scrolled with memcpy and updated with poke
+-- libs:
+
+Screen = NibbleScreen
+Memory = NibbleMemory
+
+SCREEN = 0x6000
+ROW = 64 -- bytes per line
+
+for y = 0, 127 do
+    for x = 0, ROW - 1 do
+        Memory.poke(SCREEN + y * ROW + x, (x + y) % 16 * 17)
+    end
+end
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+
+    -- scroll up one line, then draw a new bottom line byte by byte
+    Memory.memcpy(SCREEN, SCREEN + ROW, ROW * 127)
+    for x = 0, ROW - 1 do
+        Memory.poke(SCREEN + 127 * ROW + x, (x + frame) % 16 * 17)
+    end
+
+    -- checksum a column of the map through peek
+    local sum = 0
+    for y = 0, 127 do
+        sum = sum + Memory.peek(SCREEN + y * ROW + frame % ROW)
+    end
+    Memory.poke2(0x3000, sum)
+end
@@ -0,0 +1,46 @@
+-- Benchmark: Lua-side game logic, particles updated at a fixed rate and interpolated
+-- libs: math
+
+Screen = NibbleScreen
+
+particles = {}
+
+local function spawn(p)
+    p.x = 64
+    p.y = 64
+    p.dx = (math.random() - 0.5) * 4
+    p.dy = (math.random() - 0.5) * 4
+    p.life = math.random(30, 90)
+    p.px = p.x
+    p.py = p.y
+    return p
+end
+
+for i = 1, 1000 do
+    particles[i] = spawn({})
+end
+
+function _update()
+    for i = 1, #particles do
+        local p = particles[i]
+        p.px = p.x
+        p.py = p.y
+        p.x = p.x + p.dx
+        p.y = p.y + p.dy
+        p.dy = p.dy + 0.05
+        p.life = p.life - 1
+        if p.life <= 0 then
+            spawn(p)
+        end
+    end
+end
+
+function _draw(alpha)
+    Screen.rectfill(0, 0, 127, 127, 0)
+    for i = 1, #particles do
+        local p = particles[i]
+        local x = p.px + (p.x - p.px) * alpha
+        local y = p.py + (p.y - p.py) * alpha
+        Screen.pset(x // 1, y // 1, p.life % 16)
+    end
+end
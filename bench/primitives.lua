@@ -0,0 +1,31 @@
+-- Benchmark: drawing primitives, a scrolling starfield under a split-screen view
+-- libs: math
+
+Screen = NibbleScreen
+
+stars = {}
+for i = 1, 300 do
+    stars[i] = {x = math.random(0, 1023), y = math.random(0, 127), c = math.random(1, 15)}
+end
+scroll = 0
+
+function _screen_draw(delta)
+    scroll = scroll + 1
+    Screen.rectfill(0, 0, 127, 127, 0)
+
+    for half = 0, 1 do
+        Screen.clip(half * 64, 0, 64, 128)
+        Screen.camera(scroll * (half + 1), 0)
+        for i = 1, #stars do
+            local star = stars[i]
+            Screen.pset(star.x, star.y, star.c)
+        end
+        for i = 0, 15 do
+            Screen.line(scroll + i * 8, 0, scroll + 127 - i * 8, 127, i)
+            Screen.rectfill(scroll + i * 8, i * 8, scroll + i * 8 + 6, i * 8 + 6, 15 - i)
+        end
+    end
+
+    Screen.camera()
+    Screen.clip()
+end
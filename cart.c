@@ -0,0 +1,439 @@
+#include "cart.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "alloccount.h"
+
+static int lib_system_stat(lua_State* L) {
+    Cart* cart = lua_touserdata(L, lua_upvalueindex(1));
+    const ScreenStats* stats = &cart->screen->last_stats;
+    double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+    int n = luaL_checkinteger(L, 1);
+
+    switch (n) {
+        case CART_STAT_MEMORY:
+            lua_pushnumber(L, cart_memory(cart) / 1024.0);
+            break;
+        case CART_STAT_LUA_TIME:
+            lua_pushnumber(L, cart->last_lua_ticks * ms_per_tick);
+            break;
+        case CART_STAT_RASTER_TIME:
+            lua_pushnumber(L, stats->raster_ticks * ms_per_tick);
+            break;
+        case CART_STAT_BLIT_TIME:
+            lua_pushnumber(L, stats->blit_ticks * ms_per_tick);
+            break;
+        case CART_STAT_GC_COUNT:
+            lua_pushinteger(L, cart->gc_cycles);
+            break;
+        case CART_STAT_PSET_CALLS:
+            lua_pushinteger(L, stats->calls[SCREEN_PRIM_PSET]);
+            break;
+        case CART_STAT_RECTFILL_CALLS:
+            lua_pushinteger(L, stats->calls[SCREEN_PRIM_RECTFILL]);
+            break;
+        case CART_STAT_LINE_CALLS:
+            lua_pushinteger(L, stats->calls[SCREEN_PRIM_LINE]);
+            break;
+        case CART_STAT_PRIM_CALLS: {
+            lua_Integer total = 0;
+            for (int i = 0; i < SCREEN_PRIM_COUNT; i++) {
+                total += stats->calls[i];
+            }
+            lua_pushinteger(L, total);
+            break;
+        }
+        case CART_STAT_ALLOCS:
+            lua_pushinteger(L, cart->frame_allocs);
+            break;
+        default:
+            return luaL_error(L, "System error: stat %d does not exist", n);
+    }
+
+    return 1;
+}
+
+// screenshot(): saves a PNG of the screen, returns the file name or nil
+static int lib_system_screenshot(lua_State* L) {
+    Cart* cart = lua_touserdata(L, lua_upvalueindex(1));
+    char filename[64];
+
+    if (cart->screenshots != NULL && screenshot_take(cart->screenshots, cart->screen, filename, sizeof(filename))) {
+        lua_pushstring(L, filename);
+    } else {
+        lua_pushnil(L);
+    }
+
+    return 1;
+}
+
+static const luaL_Reg SystemLib[] = {
+    {"stat", lib_system_stat},
+    {"screenshot", lib_system_screenshot},
+    {NULL, NULL}
+};
+
+// Finalizer of an unreachable table that replaces itself every time it is collected,
+// so it runs once per completed garbage collection cycle
+static int cart_gc_sentinel(lua_State* L) {
+    Cart* cart = lua_touserdata(L, lua_upvalueindex(1));
+
+    if (cart->closing) {
+        return 0;
+    }
+
+    cart->gc_cycles++;
+
+    lua_newtable(L);
+    lua_pushvalue(L, lua_upvalueindex(2));
+    lua_setmetatable(L, -2);
+    lua_pop(L, 1);
+
+    return 0;
+}
+
+static void cart_install_gc_sentinel(Cart* cart) {
+    lua_State* L = cart->L;
+
+    lua_newtable(L); // metatable
+    lua_pushlightuserdata(L, cart);
+    lua_pushvalue(L, -2);
+    lua_pushcclosure(L, cart_gc_sentinel, 2);
+    lua_setfield(L, -2, "__gc");
+
+    lua_newtable(L);
+    lua_pushvalue(L, -2);
+    lua_setmetatable(L, -2);
+    lua_pop(L, 2);
+}
+
+// Standard libraries a cart can ask for, bit i of a mask stands for entry i
+static const luaL_Reg CartLibs[] = {
+    {LUA_GNAME, luaopen_base},
+    {LUA_LOADLIBNAME, luaopen_package},
+    {LUA_COLIBNAME, luaopen_coroutine},
+    {LUA_TABLIBNAME, luaopen_table},
+    {LUA_IOLIBNAME, luaopen_io},
+    {LUA_OSLIBNAME, luaopen_os},
+    {LUA_STRLIBNAME, luaopen_string},
+    {LUA_MATHLIBNAME, luaopen_math},
+    {LUA_UTF8LIBNAME, luaopen_utf8},
+    {LUA_DBLIBNAME, luaopen_debug},
+    {NULL, NULL}
+};
+
+#define CART_LIBS_ALL (~0u)
+#define CART_LIBS_MAX_LINE 1024
+
+// Mask of the libraries declared by a "-- libs: math, string" line in the comments at the
+// top of the cart. The base library is always opened, carts without the line get them all.
+static unsigned int cart_declared_libs(const char* filename) {
+    FILE* file = fopen(filename, "r");
+    if (file == NULL) {
+        return CART_LIBS_ALL; // reported when the cart gets loaded
+    }
+
+    unsigned int libs = CART_LIBS_ALL;
+    char line[CART_LIBS_MAX_LINE];
+
+    while (fgets(line, sizeof(line), file) != NULL) {
+        char* p = line + strspn(line, " \t\r\n");
+        if (*p == '\0' || *p == '#') { // blank or the #! line skipped by luaL_loadfile
+            continue;
+        }
+        if (strncmp(p, "--", 2) != 0) {
+            break;
+        }
+        p += 2 + strspn(p + 2, " \t");
+        if (strncmp(p, "libs:", 5) != 0) {
+            continue;
+        }
+
+        libs = 1;
+        for (p += 5; *p != '\0'; ) {
+            p += strspn(p, " \t\r\n,");
+            size_t length = strcspn(p, " \t\r\n,");
+            if (length == 0) {
+                break;
+            }
+
+            int i = 0;
+            while (CartLibs[i].name != NULL && (strlen(CartLibs[i].name) != length || strncmp(CartLibs[i].name, p, length) != 0)) {
+                i++;
+            }
+            if (CartLibs[i].name != NULL) {
+                libs |= 1u << i;
+            } else {
+                printf("! %s: unknown library %.*s\n", filename, (int) length, p);
+            }
+            p += length;
+        }
+        break;
+    }
+
+    fclose(file);
+    return libs;
+}
+
+void cart_options_init(CartOptions* options) {
+    memset(options, 0, sizeof(CartOptions));
+    watchdog_init(&options->watchdog);
+    options->update_hz = CART_DEFAULT_UPDATE_HZ;
+}
+
+// Count hook shared by the watchdog and the profiler
+static void cart_hook(lua_State* L, lua_Debug* ar) {
+    Cart* cart = *(Cart**) lua_getextraspace(L);
+
+    // sampled first, the watchdog may not return
+    if (cart->profiler != NULL) {
+        profiler_sample(cart->profiler, L);
+    }
+    if (watchdog_enabled(&cart->watchdog)) {
+        watchdog_check(&cart->watchdog, L, cart->hook_interval);
+    }
+}
+
+// Runs before and after every Lua callback
+static void cart_arm(Cart* cart, const char* callback) {
+    watchdog_arm(&cart->watchdog, callback);
+    if (cart->profiler != NULL) {
+        profiler_arm(cart->profiler, callback);
+    }
+}
+
+static int cart_disarm(Cart* cart) {
+    if (cart->profiler != NULL) {
+        profiler_disarm(cart->profiler);
+    }
+    return watchdog_disarm(&cart->watchdog);
+}
+
+Cart* cart_new(const char* filename, Screen* screen, const CartOptions* options) {
+    Cart* cart = malloc(sizeof(Cart));
+    memset(cart, 0, sizeof(Cart));
+
+    cart->filename = filename;
+    cart->screen = screen;
+    cart->watchdog = options->watchdog;
+    cart->profiler = options->profiler;
+    screen->timed = cart->profiler != NULL;
+    cart->update_hz = options->update_hz > 0 ? options->update_hz : CART_DEFAULT_UPDATE_HZ;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    cart->L = luaL_newstate();
+
+    lua_State* L = cart->L;
+
+    // the allocator of luaL_newstate, counted, blocks it already gave out are freed the same way
+    lua_setallocf(L, alloccount_lua, &cart->allocs);
+
+    // samples are taken at the profiler's interval, the watchdog is happy with any
+    if (cart->profiler != NULL) {
+        cart->hook_interval = cart->profiler->interval;
+    } else if (watchdog_enabled(&cart->watchdog)) {
+        cart->hook_interval = WATCHDOG_HOOK_INTERVAL;
+    }
+    if (cart->hook_interval > 0) {
+        *(Cart**) lua_getextraspace(L) = cart;
+        lua_sethook(L, cart_hook, LUA_MASKCOUNT, cart->hook_interval);
+    }
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    cart->startup.state_ticks = now - start;
+    start = now;
+
+    // what luaL_openlibs does, for the declared libraries only
+    unsigned int libs = cart_declared_libs(filename);
+    for (int i = 0; CartLibs[i].name != NULL; i++) {
+        if (libs & (1u << i)) {
+            luaL_requiref(L, CartLibs[i].name, CartLibs[i].func, 1);
+            lua_pop(L, 1);
+        }
+    }
+
+    // a cart without math has no random numbers to seed
+    if (options->seeded) {
+        if (lua_getglobal(L, "math") == LUA_TTABLE) {
+            lua_getfield(L, -1, "randomseed");
+            lua_pushinteger(L, options->seed);
+            lua_call(L, 1, 0);
+        }
+        lua_pop(L, 1);
+    }
+
+    // Screen library
+    screen_openlib(L, screen);
+
+    // Input library
+    input_openlib(L, &cart->input);
+
+    // Memory library
+    memory_init(&cart->memory, screen);
+    memory_openlib(L, &cart->memory);
+
+    // Audio library
+    audio_openlib(L, options->audio);
+
+    // System library
+    lua_newtable(L);
+    lua_pushlightuserdata(L, cart);
+    luaL_setfuncs(L, SystemLib, 1);
+    lua_setglobal(L, "NibbleSystem");
+
+    cart_install_gc_sentinel(cart);
+
+    now = SDL_GetPerformanceCounter();
+    cart->startup.libs_ticks = now - start;
+    start = now;
+
+    // compile, then run everything not inside of a function, as luaL_dofile does
+    int status = luaL_loadfile(L, filename);
+
+    now = SDL_GetPerformanceCounter();
+    cart->startup.compile_ticks = now - start;
+    start = now;
+
+    if (status == LUA_OK) {
+        cart_arm(cart, "main chunk");
+        status = lua_pcall(L, 0, LUA_MULTRET, 0);
+        cart_disarm(cart);
+    }
+    if (status != LUA_OK) {
+        printf("! Lua error: %s\n", lua_tostring(L, lua_gettop(L)));
+    }
+    lua_pop(L, lua_gettop(L));
+    cart->main_status = status;
+
+    cart->startup.main_ticks = SDL_GetPerformanceCounter() - start;
+
+    // whatever the main chunk put in RAM is what reload restores
+    memory_freeze(&cart->memory);
+
+    return cart;
+}
+
+// Calls the function below its nargs arguments on the stack under the watchdog.
+// Returns 1 on a Lua error, 0 on success or when the watchdog dropped the call.
+static int cart_call(Cart* cart, const char* name, int nargs) {
+    lua_State* L = cart->L;
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    cart_arm(cart, name);
+    int status = lua_pcall(L, nargs, 0, 0);
+    int aborted = cart_disarm(cart);
+    cart->lua_ticks += SDL_GetPerformanceCounter() - start;
+
+    if (status == LUA_OK) {
+        lua_pop(L, lua_gettop(L));
+    } else if (aborted) {
+        // the watchdog already reported the stack, drop this call and carry on
+        lua_pop(L, lua_gettop(L));
+    } else {
+        printf("! Lua error: %s\n", lua_tostring(L, lua_gettop(L)));
+        lua_pop(L, lua_gettop(L));
+        return 1;
+    }
+
+    return 0;
+}
+
+// _update() as many times as the fixed ticks that fit in the time passed, then _draw(alpha)
+static int cart_update_and_draw(Cart* cart, unsigned int delta) {
+    lua_State* L = cart->L;
+
+    cart->update_time += (Uint64) delta * cart->update_hz;
+    Uint64 ticks = cart->update_time / 1000;
+    cart->update_time %= 1000;
+
+    // after a long stall, e.g. the first frame, skip ahead rather than trying to catch up
+    if (ticks > CART_MAX_UPDATES_PER_FRAME) {
+        ticks = CART_MAX_UPDATES_PER_FRAME;
+    }
+
+    // button presses wait for the next _update, or go to _draw when there is none
+    int updating = lua_getglobal(L, "_update") == LUA_TFUNCTION;
+    lua_pop(L, 1);
+
+    for (Uint64 i = 0; i < ticks && updating; i++) {
+        if (lua_getglobal(L, "_update") != LUA_TFUNCTION) {
+            lua_pop(L, 1);
+            break;
+        }
+        int status = cart_call(cart, "_update", 0);
+        input_consume(&cart->input);
+        if (status) {
+            return 1;
+        }
+        cart->updates++;
+    }
+
+    if (lua_getglobal(L, "_draw") != LUA_TFUNCTION) {
+        lua_pop(L, 1);
+        return 0;
+    }
+
+    // how far into the next tick the frame is, to interpolate between the last two updates
+    lua_pushnumber(L, cart->update_time / 1000.0);
+    int status = cart_call(cart, "_draw", 1);
+    if (!updating) {
+        input_consume(&cart->input);
+    }
+    return status;
+}
+
+static int cart_run_frame(Cart* cart, unsigned int delta) {
+    lua_State* L = cart->L;
+
+    lua_getglobal(L, "_update");
+    lua_getglobal(L, "_draw");
+    int fixed_rate = lua_isfunction(L, -2) || lua_isfunction(L, -1);
+    lua_pop(L, 2);
+
+    if (fixed_rate) {
+        return cart_update_and_draw(cart, delta);
+    }
+
+    // evaluate draw function: _screen_draw(delta)
+    lua_getglobal(L, "_screen_draw");
+    if (!lua_isfunction(L, -1)) {
+        lua_pop(L, 1);
+        return 0;
+    }
+
+    lua_pushinteger(L, delta);
+    int status = cart_call(cart, "_screen_draw", 1);
+    input_consume(&cart->input);
+    return status;
+}
+
+int cart_draw(Cart* cart, unsigned int delta) {
+    unsigned long allocs = cart->allocs;
+
+    screen_stats_rollover(cart->screen);
+    cart->last_lua_ticks = cart->lua_ticks;
+    cart->lua_ticks = 0;
+
+    int status = cart_run_frame(cart, delta);
+
+    cart->frame_allocs = cart->allocs - allocs;
+    if (cart->profiler != NULL) {
+        profiler_frame(cart->profiler, cart->frame_allocs);
+    }
+
+    return status;
+}
+
+size_t cart_memory(Cart* cart) {
+    return (size_t) lua_gc(cart->L, LUA_GCCOUNT) * 1024 + lua_gc(cart->L, LUA_GCCOUNTB);
+}
+
+void cart_free(Cart* cart) {
+    if (cart != NULL) {
+        cart->closing = 1;
+        lua_close(cart->L);
+        free(cart);
+    }
+}
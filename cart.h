@@ -0,0 +1,98 @@
+#ifndef CART_H
+#define CART_H
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "audio.h"
+#include "input.h"
+#include "memory.h"
+#include "nblscreen.h"
+#include "profiler.h"
+#include "screenshot.h"
+#include "watchdog.h"
+
+// Queries answered by NibbleSystem.stat(n)
+typedef enum CartStat {
+    CART_STAT_MEMORY = 0, // KB used by the Lua heap
+    CART_STAT_LUA_TIME = 1, // ms spent in Lua callbacks during the last frame
+    CART_STAT_RASTER_TIME = 2, // ms spent in drawing primitives during the last frame, 0 unless profiling
+    CART_STAT_BLIT_TIME = 3, // ms spent in screen_blit for the last frame
+    CART_STAT_GC_COUNT = 4, // completed garbage collection cycles
+    CART_STAT_PSET_CALLS = 5, // primitive calls during the last frame
+    CART_STAT_RECTFILL_CALLS = 6,
+    CART_STAT_LINE_CALLS = 7,
+    CART_STAT_PRIM_CALLS = 8, // all primitives
+    CART_STAT_ALLOCS = 9 // Lua allocations during the last frame
+} CartStat;
+
+#define CART_DEFAULT_UPDATE_HZ 60
+#define CART_MAX_UPDATES_PER_FRAME 10
+
+typedef struct CartOptions {
+    Watchdog watchdog; // budgets to enforce, each cart keeps its own copy
+    int seeded; // seed math.random with seed instead of a random value, for reproducible runs
+    lua_Integer seed;
+    unsigned int update_hz; // rate of _update
+    Profiler* profiler; // samples the callbacks when set, not owned by the cart
+    Audio* audio; // played by NibbleAudio, NULL for silence, not owned by the cart
+} CartOptions;
+
+void cart_options_init(CartOptions* options);
+
+// Time spent in each phase of cart_new
+typedef struct CartStartup {
+    Uint64 state_ticks; // luaL_newstate
+    Uint64 libs_ticks; // standard libraries declared by the cart and the Nibble ones
+    Uint64 compile_ticks; // loading the file
+    Uint64 main_ticks; // running the main chunk
+} CartStartup;
+
+// A cartridge instance: one Lua state bound to one Screen.
+// Instances share nothing, so different carts can run on different threads.
+typedef struct Cart {
+    const char* filename;
+    lua_State* L;
+    Screen* screen;
+    Watchdog watchdog;
+    Profiler* profiler;
+    unsigned int hook_interval; // Lua instructions between two calls of the count hook, 0 = no hook
+    Input input;
+    Memory memory;
+    Screenshotter* screenshots; // NULL when screenshots aren't available, e.g. in host mode
+
+    CartStartup startup;
+    int main_status; // LUA_OK if the main chunk compiled and ran without an error
+
+    unsigned int update_hz;
+    Uint64 update_time; // ms since the last _update, times update_hz
+    unsigned long updates;
+
+    Uint64 lua_ticks; // time spent in Lua callbacks during the frame being run
+    Uint64 last_lua_ticks; // during the last complete frame
+    unsigned long allocs; // blocks allocated by the Lua heap so far
+    unsigned long frame_allocs; // during the last frame
+    unsigned long gc_cycles;
+    int closing;
+} Cart;
+
+// Creates the Lua state and runs everything not inside of a function.
+// Only the standard libraries named by a "-- libs: math, string" comment line at the top of
+// the file are opened, along with the base library; all of them when there is no such line.
+// Touches nothing of the screen but its framebuffer, palettes and timed flag, so the window
+// can be opened on another thread meanwhile.
+Cart* cart_new(const char* filename, Screen* screen, const CartOptions* options);
+
+// Runs one frame of the cart. Carts defining _update or _draw get _update() at a fixed
+// rate of update_hz, as many times as fit in delta, then _draw(alpha) with alpha in [0, 1)
+// being how far into the next update the frame is. Other carts get _screen_draw(delta).
+// Returns 0 on success or when the watchdog dropped the frame, 1 on a Lua error.
+int cart_draw(Cart* cart, unsigned int delta);
+
+// Bytes used by the Lua heap of the cart
+size_t cart_memory(Cart* cart);
+
+void cart_free(Cart* cart);
+
+#endif
@@ -0,0 +1,80 @@
+#include "filewatch.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef __linux__
+
+#include <sys/inotify.h>
+#include <unistd.h>
+
+FileWatch* filewatch_new(const char* filename) {
+    const char* slash = strrchr(filename, '/');
+    char directory[4096];
+
+    if (slash == NULL) {
+        strcpy(directory, ".");
+    } else if ((size_t) (slash - filename) < sizeof(directory)) {
+        // "/cart.lua" lives in "/"
+        size_t length = slash > filename ? (size_t) (slash - filename) : 1;
+        memcpy(directory, filename, length);
+        directory[length] = '\0';
+    } else {
+        return NULL;
+    }
+
+    int fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (fd < 0) {
+        return NULL;
+    }
+    if (inotify_add_watch(fd, directory, IN_CLOSE_WRITE | IN_MOVED_TO) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    FileWatch* watch = malloc(sizeof(FileWatch));
+    watch->fd = fd;
+    watch->name = slash != NULL ? slash + 1 : filename;
+    return watch;
+}
+
+int filewatch_changed(FileWatch* watch) {
+    char buffer[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    int changed = 0;
+    ssize_t length;
+
+    // other files of the directory come up too
+    while ((length = read(watch->fd, buffer, sizeof(buffer))) > 0) {
+        for (char* p = buffer; p < buffer + length; ) {
+            const struct inotify_event* event = (const struct inotify_event*) p;
+            if (event->len > 0 && strcmp(event->name, watch->name) == 0) {
+                changed = 1;
+            }
+            p += sizeof(struct inotify_event) + event->len;
+        }
+    }
+
+    return changed;
+}
+
+void filewatch_free(FileWatch* watch) {
+    if (watch != NULL) {
+        close(watch->fd);
+        free(watch);
+    }
+}
+
+#else
+
+FileWatch* filewatch_new(const char* filename) {
+    return NULL;
+}
+
+int filewatch_changed(FileWatch* watch) {
+    return 0;
+}
+
+void filewatch_free(FileWatch* watch) {
+}
+
+#endif
@@ -0,0 +1,21 @@
+#ifndef FILEWATCH_H
+#define FILEWATCH_H
+
+// Tells when a file was written, e.g. a cart being edited. Watches the directory of the file
+// with inotify, so editors saving to a temporary file renamed over the original are caught too.
+// Only available on Linux.
+typedef struct FileWatch {
+    int fd; // non-blocking inotify instance
+    const char* name; // of the file within its directory
+} FileWatch;
+
+// Returns NULL if the file can't be watched
+FileWatch* filewatch_new(const char* filename);
+
+// 1 if the file was written or replaced since the last call, never blocks.
+// Everything that happened since counts as one change, however many writes it took.
+int filewatch_changed(FileWatch* watch);
+
+void filewatch_free(FileWatch* watch);
+
+#endif
@@ -0,0 +1,106 @@
+#include "framecodec.h"
+
+#include <string.h>
+
+#define FRAMECODEC_MIN_RUN 4 // shorter runs are cheaper as part of a literal
+
+static size_t framecodec_put_varint(Uint8* out, size_t value) {
+    size_t size = 0;
+
+    while (value >= 0x80) {
+        out[size++] = (value & 0x7F) | 0x80;
+        value >>= 7;
+    }
+    out[size++] = value;
+
+    return size;
+}
+
+static size_t framecodec_put_literal(Uint8* out, const Uint8* current, const Uint8* previous, size_t start, size_t end) {
+    size_t size = 0;
+
+    if (end > start) {
+        size += framecodec_put_varint(out, (end - start) * 2 + 1);
+        for (size_t i = start; i < end; i++) {
+            out[size++] = current[i] ^ previous[i];
+        }
+    }
+
+    return size;
+}
+
+size_t framecodec_encode(const Uint8* current, const Uint8* previous, size_t size, Uint8* out) {
+    size_t out_size = 0;
+    size_t literal_start = 0;
+    size_t i = 0;
+
+    while (i < size) {
+        Uint8 value = current[i] ^ previous[i];
+        size_t run = 1;
+        while (i + run < size && (current[i + run] ^ previous[i + run]) == value) {
+            run++;
+        }
+
+        if (run >= FRAMECODEC_MIN_RUN) {
+            out_size += framecodec_put_literal(out + out_size, current, previous, literal_start, i);
+            out_size += framecodec_put_varint(out + out_size, run * 2);
+            out[out_size++] = value;
+            literal_start = i + run;
+        }
+
+        i += run;
+    }
+
+    out_size += framecodec_put_literal(out + out_size, current, previous, literal_start, size);
+
+    return out_size;
+}
+
+int framecodec_decode(const Uint8* in, size_t in_size, Uint8* buffer, size_t size) {
+    size_t in_pos = 0;
+    size_t pos = 0;
+
+    while (in_pos < in_size) {
+        size_t n = 0;
+        int shift = 0;
+        Uint8 byte;
+
+        do {
+            if (in_pos >= in_size || shift > 56) {
+                return 0;
+            }
+            byte = in[in_pos++];
+            n |= (size_t) (byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+
+        size_t count = n / 2;
+        if (count > size - pos) {
+            return 0;
+        }
+
+        if (n & 1) {
+            if (count > in_size - in_pos) {
+                return 0;
+            }
+            for (size_t i = 0; i < count; i++) {
+                buffer[pos + i] ^= in[in_pos + i];
+            }
+            in_pos += count;
+        } else {
+            if (in_pos >= in_size) {
+                return 0;
+            }
+            Uint8 value = in[in_pos++];
+            if (value) {
+                for (size_t i = 0; i < count; i++) {
+                    buffer[pos + i] ^= value;
+                }
+            }
+        }
+
+        pos += count;
+    }
+
+    return pos == size;
+}
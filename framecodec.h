@@ -0,0 +1,25 @@
+#ifndef FRAMECODEC_H
+#define FRAMECODEC_H
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+// Delta coding of byte buffers such as the nibble framebuffer: the XOR of the new buffer
+// against the previous one, run-length encoded. Unchanged buffers cost a handful of bytes.
+//
+// The encoding is a sequence of tokens, each starting with a varint n:
+//   n even: a run of n / 2 copies of the byte that follows
+//   n odd:  n / 2 literal bytes follow
+
+// Upper bound of the encoded size of a buffer of size bytes
+#define FRAMECODEC_MAX_SIZE(size) ((size) + (size) / 64 + 16)
+
+// Encodes current against previous into out, returns the encoded size
+size_t framecodec_encode(const Uint8* current, const Uint8* previous, size_t size, Uint8* out);
+
+// Applies an encoded delta to buffer, turning the previous buffer into the current one.
+// Returns 0 if the input is malformed or doesn't cover exactly size bytes.
+int framecodec_decode(const Uint8* in, size_t in_size, Uint8* buffer, size_t size);
+
+#endif
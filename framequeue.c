@@ -0,0 +1,80 @@
+#include "framequeue.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+FrameQueue* framequeue_new(int capacity) {
+    FrameQueue* queue = malloc(sizeof(FrameQueue));
+    memset(queue, 0, sizeof(FrameQueue));
+
+    queue->slots = malloc(sizeof(FrameSnapshot) * capacity);
+    queue->capacity = capacity;
+    queue->ready = SDL_CreateSemaphore(0);
+
+    return queue;
+}
+
+int framequeue_push(FrameQueue* queue, const Screen* screen, unsigned int delta) {
+    int head = SDL_AtomicGet(&queue->head);
+
+    if (head - SDL_AtomicGet(&queue->tail) >= queue->capacity) {
+        queue->dropped++;
+        return 0;
+    }
+
+    FrameSnapshot* frame = &queue->slots[head % queue->capacity];
+    memcpy(frame->pixels, screen->pixels, SCREEN_BUFFER_SIZE);
+    screen_display_colors(screen, frame->colors);
+    frame->delta = delta;
+    frame->sequence = queue->pushed++;
+
+    // the snapshot has to be complete before the consumer can see the new head
+    SDL_MemoryBarrierRelease();
+    SDL_AtomicSet(&queue->head, head + 1);
+    SDL_SemPost(queue->ready);
+
+    return 1;
+}
+
+unsigned long framequeue_next_sequence(FrameQueue* queue) {
+    return queue->pushed;
+}
+
+void framequeue_close(FrameQueue* queue) {
+    SDL_AtomicSet(&queue->closed, 1);
+    SDL_SemPost(queue->ready);
+}
+
+FrameSnapshot* framequeue_peek(FrameQueue* queue) {
+    int tail = SDL_AtomicGet(&queue->tail);
+
+    while (tail == SDL_AtomicGet(&queue->head)) {
+        if (SDL_AtomicGet(&queue->closed)) {
+            return NULL;
+        }
+        SDL_SemWait(queue->ready);
+    }
+
+    SDL_MemoryBarrierAcquire();
+    return &queue->slots[tail % queue->capacity];
+}
+
+void framequeue_pop(FrameQueue* queue) {
+    SDL_AtomicAdd(&queue->tail, 1);
+}
+
+void framequeue_free(FrameQueue* queue) {
+    if (queue != NULL) {
+        SDL_DestroySemaphore(queue->ready);
+        free(queue->slots);
+        free(queue);
+    }
+}
+
+void framequeue_unpack(const FrameSnapshot* frame, Uint8* indices) {
+    // even pixels sit in the low nibble, see screen_pset
+    for (int i = 0; i < SCREEN_BUFFER_SIZE; i++) {
+        indices[i * 2] = frame->pixels[i] & 0x0F;
+        indices[i * 2 + 1] = frame->pixels[i] >> 4;
+    }
+}
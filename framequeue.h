@@ -0,0 +1,51 @@
+#ifndef FRAMEQUEUE_H
+#define FRAMEQUEUE_H
+
+#include "SDL.h"
+
+#include "nblscreen.h"
+
+// Copy of everything needed to reproduce a frame away from the main loop
+typedef struct FrameSnapshot {
+    Uint8 pixels[SCREEN_BUFFER_SIZE];
+    Color colors[16]; // as displayed, through the display palette
+    unsigned int delta; // ms since the previous frame
+    unsigned long sequence; // number of frames pushed to the queue before this one
+} FrameSnapshot;
+
+// Lock-free single producer, single consumer ring of frame snapshots.
+// The main loop pushes without ever blocking: when the consumer falls behind, frames are dropped.
+typedef struct FrameQueue {
+    FrameSnapshot* slots;
+    int capacity;
+    SDL_atomic_t head; // next slot to write, only moved by the producer
+    SDL_atomic_t tail; // next slot to read, only moved by the consumer
+    SDL_atomic_t closed;
+    SDL_sem* ready; // posted once per pushed frame and once on close
+    unsigned long pushed;
+    unsigned long dropped;
+} FrameQueue;
+
+FrameQueue* framequeue_new(int capacity);
+
+// Producer side. Returns 0 if the queue was full and the frame was dropped.
+int framequeue_push(FrameQueue* queue, const Screen* screen, unsigned int delta);
+
+// Sequence number the next pushed frame will get
+unsigned long framequeue_next_sequence(FrameQueue* queue);
+
+// Wakes up the consumer once the remaining frames are consumed
+void framequeue_close(FrameQueue* queue);
+
+// Consumer side. Blocks until a frame is available, returns NULL once the queue is closed and empty.
+// The snapshot stays valid until framequeue_pop.
+FrameSnapshot* framequeue_peek(FrameQueue* queue);
+
+void framequeue_pop(FrameQueue* queue);
+
+void framequeue_free(FrameQueue* queue);
+
+// Unpacks the nibbles of a snapshot to one byte per pixel
+void framequeue_unpack(const FrameSnapshot* frame, Uint8* indices);
+
+#endif
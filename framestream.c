@@ -0,0 +1,232 @@
+#include "framestream.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+#include "framecodec.h"
+
+// Fills in a Unix or loopback TCP address, returns its size or 0 if the address is invalid
+static socklen_t framestream_address(const char* address, struct sockaddr_storage* storage) {
+    memset(storage, 0, sizeof(struct sockaddr_storage));
+
+    if (strncmp(address, "tcp:", 4) == 0) {
+        struct sockaddr_in* in = (struct sockaddr_in*) storage;
+        int port = atoi(address + 4);
+        if (port <= 0 || port > 65535) {
+            return 0;
+        }
+        in->sin_family = AF_INET;
+        in->sin_port = htons(port);
+        in->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        return sizeof(struct sockaddr_in);
+    }
+
+    struct sockaddr_un* un = (struct sockaddr_un*) storage;
+    if (strlen(address) >= sizeof(un->sun_path)) {
+        return 0;
+    }
+    un->sun_family = AF_UNIX;
+    strcpy(un->sun_path, address);
+    return sizeof(struct sockaddr_un);
+}
+
+static int framestream_send(FrameStream* stream, const Uint8* data, size_t size) {
+    while (size > 0) {
+        ssize_t sent = send(stream->client_fd, data, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR) {
+            continue;
+        }
+        if (sent < 0 && (errno == EAGAIN || errno == EWOULDBLOCK) && !SDL_AtomicGet(&stream->queue->closed)) {
+            // timed out on a viewer not reading, keep waiting unless the stream is stopping
+            continue;
+        }
+        if (sent <= 0) {
+            return 0;
+        }
+        data += sent;
+        size -= sent;
+    }
+
+    return 1;
+}
+
+static void framestream_accept(FrameStream* stream) {
+    int fd = accept(stream->listen_fd, NULL, NULL);
+    if (fd < 0) {
+        return;
+    }
+
+    // accepted sockets don't inherit O_NONBLOCK on Linux, but do elsewhere
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) & ~O_NONBLOCK);
+
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one)); // fails harmlessly on Unix sockets
+
+    // so a stalled viewer can't block the thread past framestream_stop
+    struct timeval timeout = { 0, FRAMESTREAM_SEND_TIMEOUT * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+
+    // a new viewer starts from a blank buffer and needs the palette
+    stream->client_fd = fd;
+    memset(stream->previous, 0, SCREEN_BUFFER_SIZE);
+    memset(stream->previous_colors, 0, sizeof(stream->previous_colors));
+    stream->viewers++;
+}
+
+static void framestream_send_frame(FrameStream* stream, const FrameSnapshot* frame, Uint8* message, int first) {
+    Uint8* payload = message + FRAMESTREAM_HEADER_SIZE;
+    size_t size = 0;
+    Uint8 flags = 0;
+
+    if (first || memcmp(frame->colors, stream->previous_colors, sizeof(stream->previous_colors)) != 0) {
+        flags |= FRAMESTREAM_PALETTE;
+        for (int i = 0; i < 16; i++) {
+            payload[size++] = frame->colors[i].r;
+            payload[size++] = frame->colors[i].g;
+            payload[size++] = frame->colors[i].b;
+        }
+        memcpy(stream->previous_colors, frame->colors, sizeof(stream->previous_colors));
+    }
+
+    size += framecodec_encode(frame->pixels, stream->previous, SCREEN_BUFFER_SIZE, payload + size);
+    memcpy(stream->previous, frame->pixels, SCREEN_BUFFER_SIZE);
+
+    message[0] = size;
+    message[1] = size >> 8;
+    message[2] = size >> 16;
+    message[3] = flags;
+
+    if (framestream_send(stream, message, FRAMESTREAM_HEADER_SIZE + size)) {
+        stream->frames++;
+        stream->bytes += FRAMESTREAM_HEADER_SIZE + size;
+    } else {
+        close(stream->client_fd);
+        stream->client_fd = -1;
+    }
+}
+
+static int framestream_thread(void* data) {
+    FrameStream* stream = data;
+    FrameSnapshot* frame;
+    Uint8* message = malloc(FRAMESTREAM_HEADER_SIZE + FRAMESTREAM_PALETTE_SIZE + FRAMECODEC_MAX_SIZE(SCREEN_BUFFER_SIZE));
+
+    while ((frame = framequeue_peek(stream->queue)) != NULL) {
+        int first = 0;
+        if (stream->client_fd < 0) {
+            framestream_accept(stream);
+            first = 1;
+        }
+        if (stream->client_fd >= 0) {
+            framestream_send_frame(stream, frame, message, first);
+        }
+        framequeue_pop(stream->queue);
+    }
+
+    free(message);
+
+    return 0;
+}
+
+FrameStream* framestream_start(const char* address) {
+    struct sockaddr_storage storage;
+    socklen_t size = framestream_address(address, &storage);
+    if (size == 0) {
+        return NULL;
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return NULL;
+    }
+
+    if (storage.ss_family == AF_UNIX) {
+        unlink(address); // left behind by a previous run
+    } else {
+        int one = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+    }
+
+    // the listening socket is only polled between frames
+    if (bind(fd, (struct sockaddr*) &storage, size) < 0 || listen(fd, 1) < 0 || fcntl(fd, F_SETFL, O_NONBLOCK) < 0) {
+        close(fd);
+        return NULL;
+    }
+
+    FrameStream* stream = malloc(sizeof(FrameStream));
+    memset(stream, 0, sizeof(FrameStream));
+    stream->listen_fd = fd;
+    stream->client_fd = -1;
+    if (storage.ss_family == AF_UNIX) {
+        strcpy(stream->path, address);
+    }
+    stream->queue = framequeue_new(FRAMESTREAM_QUEUE_FRAMES);
+    stream->thread = SDL_CreateThread(framestream_thread, "ves-stream", stream);
+
+    if (stream->thread == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create stream thread: %s", SDL_GetError());
+        framequeue_free(stream->queue);
+        close(fd);
+        free(stream);
+        return NULL;
+    }
+
+    return stream;
+}
+
+void framestream_push(FrameStream* stream, const Screen* screen, unsigned int delta) {
+    framequeue_push(stream->queue, screen, delta);
+}
+
+void framestream_stop(FrameStream* stream) {
+    if (stream != NULL) {
+        // a send blocked on the viewer gives up within FRAMESTREAM_SEND_TIMEOUT once the queue is closed
+        framequeue_close(stream->queue);
+        SDL_WaitThread(stream->thread, NULL);
+
+        if (stream->frames > 0) {
+            printf("Stream: sent %lu frames to %lu viewers, %.1f bytes per frame, dropped %lu\n",
+                stream->frames, stream->viewers, (double) stream->bytes / stream->frames, stream->queue->dropped);
+        }
+
+        if (stream->client_fd >= 0) {
+            close(stream->client_fd);
+        }
+        close(stream->listen_fd);
+        if (stream->path[0] != '\0') {
+            unlink(stream->path);
+        }
+        framequeue_free(stream->queue);
+        free(stream);
+    }
+}
+
+int framestream_connect(const char* address) {
+    struct sockaddr_storage storage;
+    socklen_t size = framestream_address(address, &storage);
+    if (size == 0) {
+        return -1;
+    }
+
+    int fd = socket(storage.ss_family, SOCK_STREAM, 0);
+    if (fd < 0) {
+        return -1;
+    }
+
+    if (connect(fd, (struct sockaddr*) &storage, size) < 0) {
+        close(fd);
+        return -1;
+    }
+
+    return fd;
+}
@@ -0,0 +1,49 @@
+#ifndef FRAMESTREAM_H
+#define FRAMESTREAM_H
+
+#include "SDL.h"
+
+#include "framequeue.h"
+#include "nblscreen.h"
+
+#define FRAMESTREAM_QUEUE_FRAMES 4 // kept short so a viewer sees recent frames rather than a backlog
+#define FRAMESTREAM_HEADER_SIZE 4
+#define FRAMESTREAM_PALETTE_SIZE (16 * 3)
+#define FRAMESTREAM_SEND_TIMEOUT 100 // ms a send to a stalled viewer waits before checking for a stop
+
+// Wire format: every frame is a 4 byte header, a little endian u32 holding the size of the
+// payload in its low 24 bits and flags in its high 8 bits. With FRAMESTREAM_PALETTE the payload
+// starts with the 16 palette colors as r, g, b bytes. The rest is the framecodec delta of the
+// nibble buffer against the previous frame sent on the same connection; the first frame is
+// coded against a buffer of zeros. An unchanged frame costs 8 bytes.
+#define FRAMESTREAM_PALETTE 0x01
+
+// Streams the screen to one viewer at a time (see vesview.c) over a Unix domain socket,
+// or TCP on loopback for addresses of the form tcp:<port>.
+// Frames are encoded and sent on a background thread and dropped when the viewer falls behind.
+// The viewer's socket belongs to that thread until framestream_stop has joined it.
+typedef struct FrameStream {
+    int listen_fd;
+    int client_fd; // -1 while no viewer is connected
+    char path[108]; // Unix socket to remove when stopping, empty for TCP
+    FrameQueue* queue;
+    SDL_Thread* thread;
+    Uint8 previous[SCREEN_BUFFER_SIZE];
+    Color previous_colors[16];
+    unsigned long frames;
+    unsigned long bytes;
+    unsigned long viewers;
+} FrameStream;
+
+// Returns NULL if the address can't be listened on
+FrameStream* framestream_start(const char* address);
+
+void framestream_push(FrameStream* stream, const Screen* screen, unsigned int delta);
+
+// Disconnects the viewer and removes the socket
+void framestream_stop(FrameStream* stream);
+
+// Viewer side, returns a connected socket or -1
+int framestream_connect(const char* address);
+
+#endif
@@ -0,0 +1,282 @@
+#include "gif.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define GIF_MIN_CODE_SIZE 4 // 16 colors
+#define GIF_CLEAR_CODE (1 << GIF_MIN_CODE_SIZE)
+#define GIF_MAX_CODE 4095
+#define GIF_MIN_FRAME_MS 20 // viewers play shorter delays at 100 ms, so faster frames are merged
+
+static void gif_write_u16(FILE* file, unsigned int value) {
+    fputc(value & 0xFF, file);
+    fputc((value >> 8) & 0xFF, file);
+}
+
+static void gif_write_colors(FILE* file, const Color* colors) {
+    for (int i = 0; i < 16; i++) {
+        fputc(colors[i].r, file);
+        fputc(colors[i].g, file);
+        fputc(colors[i].b, file);
+    }
+}
+
+static void gif_write_header(GifRecorder* gif, const Color* colors) {
+    FILE* file = gif->file;
+
+    fwrite("GIF89a", 1, 6, file);
+    gif_write_u16(file, SCREEN_WIDTH);
+    gif_write_u16(file, SCREEN_HEIGHT);
+    fputc(0xB3, file); // global color table of 16 colors, 4 bit color resolution
+    fputc(0, file); // background color
+    fputc(0, file); // square pixels
+    gif_write_colors(file, colors);
+
+    // loop forever
+    fputc(0x21, file);
+    fputc(0xFF, file);
+    fputc(11, file);
+    fwrite("NETSCAPE2.0", 1, 11, file);
+    fputc(3, file);
+    fputc(1, file);
+    gif_write_u16(file, 0);
+    fputc(0, file);
+
+    memcpy(gif->written_colors, colors, sizeof(gif->written_colors));
+    memcpy(gif->global_colors, colors, sizeof(gif->global_colors));
+}
+
+static void gif_flush_block(GifRecorder* gif) {
+    if (gif->block_size > 0) {
+        fputc(gif->block_size, gif->file);
+        fwrite(gif->block, 1, gif->block_size, gif->file);
+        gif->block_size = 0;
+    }
+}
+
+static void gif_write_code(GifRecorder* gif, Uint32 code, int size) {
+    gif->bits |= code << gif->bit_count;
+    gif->bit_count += size;
+
+    while (gif->bit_count >= 8) {
+        gif->block[gif->block_size++] = gif->bits & 0xFF;
+        gif->bits >>= 8;
+        gif->bit_count -= 8;
+
+        if (gif->block_size == 255) {
+            gif_flush_block(gif);
+        }
+    }
+}
+
+// LZW-compresses the indices inside the rectangle
+static void gif_write_lzw(GifRecorder* gif, const Uint8* indices, int left, int top, int width, int height) {
+    int code_size = GIF_MIN_CODE_SIZE + 1;
+    int max_code = GIF_CLEAR_CODE + 1;
+    int code = -1;
+
+    memset(gif->lzw_tree, 0, sizeof(gif->lzw_tree));
+    gif->bits = 0;
+    gif->bit_count = 0;
+    gif->block_size = 0;
+
+    fputc(GIF_MIN_CODE_SIZE, gif->file);
+    gif_write_code(gif, GIF_CLEAR_CODE, code_size);
+
+    for (int y = top; y < top + height; y++) {
+        for (int x = left; x < left + width; x++) {
+            Uint8 next = indices[x + y * SCREEN_WIDTH];
+
+            if (code < 0) {
+                code = next;
+            } else if (gif->lzw_tree[code][next]) {
+                code = gif->lzw_tree[code][next];
+            } else {
+                gif_write_code(gif, code, code_size);
+
+                gif->lzw_tree[code][next] = ++max_code;
+                if (max_code >= (1 << code_size)) {
+                    code_size++;
+                }
+
+                // the dictionary is full, start over
+                if (max_code == GIF_MAX_CODE) {
+                    gif_write_code(gif, GIF_CLEAR_CODE, code_size);
+                    memset(gif->lzw_tree, 0, sizeof(gif->lzw_tree));
+                    code_size = GIF_MIN_CODE_SIZE + 1;
+                    max_code = GIF_CLEAR_CODE + 1;
+                }
+
+                code = next;
+            }
+        }
+    }
+
+    gif_write_code(gif, code, code_size);
+    gif_write_code(gif, GIF_CLEAR_CODE, code_size);
+    gif_write_code(gif, GIF_CLEAR_CODE + 1, GIF_MIN_CODE_SIZE + 1);
+
+    if (gif->bit_count > 0) {
+        gif_write_code(gif, 0, 8 - gif->bit_count);
+    }
+    gif_flush_block(gif);
+    fputc(0, gif->file);
+}
+
+// Writes the pending frame, shown for ms, as the rectangle that changed since the last written frame
+static void gif_write_pending(GifRecorder* gif, unsigned int ms) {
+    FILE* file = gif->file;
+
+    if (gif->frames == 0) {
+        gif_write_header(gif, gif->pending_colors);
+    }
+
+    // delays are in centiseconds, round the running total so they don't drift
+    gif->elapsed_ms += ms;
+    unsigned long elapsed_cs = (gif->elapsed_ms + 5) / 10;
+    unsigned int delay = elapsed_cs - gif->elapsed_cs;
+    gif->elapsed_cs = elapsed_cs;
+
+    // a new palette recolors the whole image, so it needs a full frame
+    int new_colors = memcmp(gif->pending_colors, gif->written_colors, sizeof(gif->written_colors)) != 0;
+    int local_colors = memcmp(gif->pending_colors, gif->global_colors, sizeof(gif->global_colors)) != 0;
+
+    int left = 0;
+    int top = 0;
+    int right = SCREEN_WIDTH - 1;
+    int bottom = SCREEN_HEIGHT - 1;
+
+    if (!new_colors && gif->frames > 0) {
+        left = SCREEN_WIDTH;
+        top = SCREEN_HEIGHT;
+        right = -1;
+        bottom = -1;
+
+        for (int y = 0; y < SCREEN_HEIGHT; y++) {
+            for (int x = 0; x < SCREEN_WIDTH; x++) {
+                if (gif->pending[x + y * SCREEN_WIDTH] != gif->written[x + y * SCREEN_WIDTH]) {
+                    left = x < left ? x : left;
+                    right = x > right ? x : right;
+                    top = y < top ? y : top;
+                    bottom = y;
+                }
+            }
+        }
+
+        // nothing changed, a single pixel still carries the delay
+        if (right < 0) {
+            left = top = right = bottom = 0;
+        }
+    }
+
+    // graphic control extension: leave the previous frame in place, no transparency
+    fputc(0x21, file);
+    fputc(0xF9, file);
+    fputc(4, file);
+    fputc(0x04, file);
+    gif_write_u16(file, delay);
+    fputc(0, file);
+    fputc(0, file);
+
+    // image descriptor
+    fputc(0x2C, file);
+    gif_write_u16(file, left);
+    gif_write_u16(file, top);
+    gif_write_u16(file, right - left + 1);
+    gif_write_u16(file, bottom - top + 1);
+    if (local_colors) {
+        fputc(0x83, file); // local color table of 16 colors
+        gif_write_colors(file, gif->pending_colors);
+    } else {
+        fputc(0, file);
+    }
+
+    gif_write_lzw(gif, gif->pending, left, top, right - left + 1, bottom - top + 1);
+
+    for (int y = top; y <= bottom; y++) {
+        memcpy(gif->written + left + y * SCREEN_WIDTH, gif->pending + left + y * SCREEN_WIDTH, right - left + 1);
+    }
+    memcpy(gif->written_colors, gif->pending_colors, sizeof(gif->written_colors));
+
+    gif->frames++;
+}
+
+static int gif_thread(void* data) {
+    GifRecorder* gif = data;
+    FrameSnapshot* frame;
+    Uint8 indices[SCREEN_WIDTH * SCREEN_HEIGHT];
+
+    while ((frame = framequeue_peek(gif->queue)) != NULL) {
+        framequeue_unpack(frame, indices);
+
+        if (!gif->has_pending) {
+            memcpy(gif->pending, indices, sizeof(indices));
+            memcpy(gif->pending_colors, frame->colors, sizeof(gif->pending_colors));
+            gif->has_pending = 1;
+            gif->pending_ms = 0;
+        } else {
+            // the pending frame stays on screen until this one
+            gif->pending_ms += frame->delta;
+
+            if (memcmp(gif->pending, indices, sizeof(indices)) || memcmp(gif->pending_colors, frame->colors, sizeof(gif->pending_colors))) {
+                if (gif->pending_ms >= GIF_MIN_FRAME_MS) {
+                    gif_write_pending(gif, gif->pending_ms);
+                    gif->pending_ms = 0;
+                }
+                memcpy(gif->pending, indices, sizeof(indices));
+                memcpy(gif->pending_colors, frame->colors, sizeof(gif->pending_colors));
+            }
+        }
+
+        framequeue_pop(gif->queue);
+    }
+
+    if (gif->has_pending) {
+        gif_write_pending(gif, gif->pending_ms > GIF_MIN_FRAME_MS ? gif->pending_ms : GIF_MIN_FRAME_MS);
+    }
+    fputc(0x3B, gif->file);
+
+    return 0;
+}
+
+GifRecorder* gif_start(const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    GifRecorder* gif = malloc(sizeof(GifRecorder));
+    memset(gif, 0, sizeof(GifRecorder));
+    gif->file = file;
+    gif->queue = framequeue_new(GIF_QUEUE_FRAMES);
+    gif->thread = SDL_CreateThread(gif_thread, "ves-gif", gif);
+
+    if (gif->thread == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create GIF thread: %s", SDL_GetError());
+        framequeue_free(gif->queue);
+        fclose(file);
+        free(gif);
+        return NULL;
+    }
+
+    return gif;
+}
+
+void gif_push(GifRecorder* gif, const Screen* screen, unsigned int delta) {
+    framequeue_push(gif->queue, screen, delta);
+}
+
+void gif_stop(GifRecorder* gif) {
+    if (gif != NULL) {
+        framequeue_close(gif->queue);
+        SDL_WaitThread(gif->thread, NULL);
+
+        if (gif->queue->dropped) {
+            printf("GIF: dropped %lu frames, the encoder couldn't keep up\n", gif->queue->dropped);
+        }
+
+        fclose(gif->file);
+        framequeue_free(gif->queue);
+        free(gif);
+    }
+}
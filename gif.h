@@ -0,0 +1,49 @@
+#ifndef GIF_H
+#define GIF_H
+
+#include <stdio.h>
+
+#include "SDL.h"
+
+#include "framequeue.h"
+#include "nblscreen.h"
+
+#define GIF_QUEUE_FRAMES 64
+
+// Records frames to an animated GIF. The main loop only copies the framebuffer into a ring,
+// LZW encoding runs on a background thread.
+typedef struct GifRecorder {
+    FILE* file;
+    FrameQueue* queue;
+    SDL_Thread* thread;
+
+    // owned by the encoder thread
+    Uint8 written[SCREEN_WIDTH * SCREEN_HEIGHT]; // what a viewer shows after the frames written so far
+    Color written_colors[16];
+    Color global_colors[16];
+    Uint8 pending[SCREEN_WIDTH * SCREEN_HEIGHT]; // last frame received, written once its duration is known
+    Color pending_colors[16];
+    int has_pending;
+    unsigned int pending_ms;
+    unsigned long elapsed_ms; // total duration of the written frames
+    unsigned long elapsed_cs; // same, as rounded in the GIF delays
+    unsigned long frames;
+
+    // LZW state
+    Uint16 lzw_tree[4096][16]; // code of prefix + next index, 0 when not in the dictionary yet
+    Uint8 block[255];
+    int block_size;
+    Uint32 bits;
+    int bit_count;
+} GifRecorder;
+
+// Returns NULL if the file can't be opened
+GifRecorder* gif_start(const char* filename);
+
+// Never blocks, drops the frame if the encoder is behind
+void gif_push(GifRecorder* gif, const Screen* screen, unsigned int delta);
+
+// Waits for the encoder to finish the queued frames and closes the file
+void gif_stop(GifRecorder* gif);
+
+#endif
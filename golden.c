@@ -0,0 +1,129 @@
+#include "golden.h"
+
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define GOLDEN_VERSION 1
+#define GOLDEN_FNV_OFFSET 0xCBF29CE484222325ULL
+#define GOLDEN_FNV_PRIME 0x100000001B3ULL
+
+Uint64 golden_hash(const Screen* screen) {
+    Uint64 hash = GOLDEN_FNV_OFFSET;
+    size_t i = 0;
+
+    for (; i + 8 <= SCREEN_BUFFER_SIZE; i += 8) {
+        // little endian whatever the host, so golden files are portable
+        const Uint8* bytes = screen->pixels + i;
+        Uint64 word = 0;
+        for (int b = 0; b < 8; b++) {
+            word |= (Uint64) bytes[b] << (b * 8);
+        }
+        hash = (hash ^ word) * GOLDEN_FNV_PRIME;
+    }
+    for (; i < SCREEN_BUFFER_SIZE; i++) {
+        hash = (hash ^ screen->pixels[i]) * GOLDEN_FNV_PRIME;
+    }
+
+    for (int c = 0; c < 16; c++) {
+        hash = (hash ^ screen->colors[c].r) * GOLDEN_FNV_PRIME;
+        hash = (hash ^ screen->colors[c].g) * GOLDEN_FNV_PRIME;
+        hash = (hash ^ screen->colors[c].b) * GOLDEN_FNV_PRIME;
+    }
+
+    // only once used, so goldens of carts without raster effects stay valid
+    if (screen->raster.active) {
+        const Uint8* raster = (const Uint8*) &screen->raster;
+        for (size_t r = 0; r < offsetof(ScreenRaster, active); r++) {
+            hash = (hash ^ raster[r]) * GOLDEN_FNV_PRIME;
+        }
+    }
+
+    return hash;
+}
+
+Golden* golden_open(const char* filename, int writing, unsigned int every) {
+    FILE* file = fopen(filename, writing ? "w" : "r");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    if (writing) {
+        every = every > 0 ? every : 1;
+        fprintf(file, "ves-golden %d %u\n", GOLDEN_VERSION, every);
+    } else {
+        int version;
+        if (fscanf(file, "ves-golden %d %u", &version, &every) != 2 || version != GOLDEN_VERSION || every == 0) {
+            fclose(file);
+            return NULL;
+        }
+    }
+
+    Golden* golden = malloc(sizeof(Golden));
+    memset(golden, 0, sizeof(Golden));
+    golden->file = file;
+    golden->writing = writing;
+    golden->every = every;
+
+    return golden;
+}
+
+void golden_frame(Golden* golden, const Screen* screen, unsigned long frame) {
+    if (frame % golden->every != 0) {
+        return;
+    }
+
+    Uint64 hash = golden_hash(screen);
+    golden->checked++;
+
+    if (golden->writing) {
+        fprintf(golden->file, "%lu %016" PRIx64 "\n", frame, (uint64_t) hash);
+        return;
+    }
+
+    unsigned long expected_frame;
+    uint64_t expected;
+    if (golden->ended || fscanf(golden->file, "%lu %" SCNx64, &expected_frame, &expected) != 2) {
+        golden->ended = 1;
+        golden->checked--; // not a checkpoint of the golden run
+        return;
+    }
+
+    if (expected_frame != frame || expected != hash) {
+        if (golden->mismatches < GOLDEN_MAX_REPORTED) {
+            printf("! Golden: frame %lu hashes to %016" PRIx64 ", expected %016" PRIx64 " at frame %lu\n",
+                frame, (uint64_t) hash, expected, expected_frame);
+        }
+        golden->mismatches++;
+    }
+}
+
+unsigned long golden_close(Golden* golden) {
+    if (golden == NULL) {
+        return 0;
+    }
+
+    unsigned long missing = 0;
+    if (!golden->writing) {
+        unsigned long expected_frame;
+        uint64_t expected;
+        while (!golden->ended && fscanf(golden->file, "%lu %" SCNx64, &expected_frame, &expected) == 2) {
+            missing++;
+        }
+    }
+
+    if (golden->writing) {
+        printf("Golden: wrote %lu checkpoints\n", golden->checked);
+    } else if (golden->mismatches == 0 && missing == 0) {
+        printf("Golden: %lu checkpoints match\n", golden->checked);
+    } else {
+        printf("! Golden: %lu of %lu checkpoints differ, %lu never reached\n", golden->mismatches, golden->checked, missing);
+    }
+
+    unsigned long failures = golden->mismatches + missing;
+    fclose(golden->file);
+    free(golden);
+
+    return failures;
+}
@@ -0,0 +1,41 @@
+#ifndef GOLDEN_H
+#define GOLDEN_H
+
+#include <stdio.h>
+
+#include "SDL.h"
+
+#include "nblscreen.h"
+
+#define GOLDEN_MAX_REPORTED 8 // mismatches printed before only counting them
+
+// Golden-frame regression checks: hashes of the framebuffer and palette of a deterministic
+// run (fixed delta, fixed seed, headless), written once from a trusted build and compared
+// bit-for-bit by later ones, e.g. after optimizing a drawing primitive.
+//
+// Text format, one checkpoint per line after the header:
+//   ves-golden 1 <every>
+//   <frame> <hash as 16 hex digits>
+typedef struct Golden {
+    FILE* file;
+    int writing;
+    unsigned int every; // hash every nth frame, starting with frame 0
+    unsigned long checked;
+    unsigned long mismatches;
+    int ended; // the file has no more checkpoints
+} Golden;
+
+// FNV-1a over the framebuffer, 64 bits at a time read as little endian, then the palette
+Uint64 golden_hash(const Screen* screen);
+
+// Checks against filename or, when writing, creates it. In check mode every comes from the file.
+// Returns NULL on failure.
+Golden* golden_open(const char* filename, int writing, unsigned int every);
+
+// Hashes the frame if it is a checkpoint. frame counts from 0.
+void golden_frame(Golden* golden, const Screen* screen, unsigned long frame);
+
+// Prints the outcome, returns the number of mismatched or missing checkpoints
+unsigned long golden_close(Golden* golden);
+
+#endif
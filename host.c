@@ -0,0 +1,119 @@
+#include "host.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "SDL.h"
+
+#include "cart.h"
+#include "nblscreen.h"
+
+typedef struct HostInstance {
+    unsigned int frames_run;
+    size_t memory; // Lua heap + screen + cart, measured after the last frame
+    int failed;
+} HostInstance;
+
+typedef struct Host {
+    const HostConfig* config;
+    HostInstance* instances;
+    SDL_atomic_t next; // index of the next instance to hand out to a worker
+} Host;
+
+static void host_run_instance(Host* host, int index) {
+    const HostConfig* config = host->config;
+    HostInstance* instance = &host->instances[index];
+
+    Screen* screen = screen_init();
+    Cart* cart = cart_new(config->filenames[index % config->filename_count], screen, &config->options);
+
+    // a main chunk that failed leaves a cart with nothing set up to run
+    if (cart->main_status != LUA_OK) {
+        instance->failed = 1;
+    }
+
+    for (unsigned int frame = 0; frame < config->frames && !instance->failed; frame++) {
+        if (cart_draw(cart, config->delta)) {
+            instance->failed = 1;
+            break;
+        }
+        instance->frames_run++;
+    }
+
+    instance->memory = cart_memory(cart) + sizeof(Screen) + sizeof(Cart);
+
+    cart_free(cart);
+    screen_free(screen);
+}
+
+static int host_worker(void* data) {
+    Host* host = data;
+
+    // instances are handed out one at a time so a slow cart doesn't hold up a whole batch
+    int index;
+    while ((index = SDL_AtomicAdd(&host->next, 1)) < host->config->instances) {
+        host_run_instance(host, index);
+    }
+
+    return 0;
+}
+
+int host_run(const HostConfig* config) {
+    Host host;
+    memset(&host, 0, sizeof(Host));
+    host.config = config;
+    host.instances = calloc(config->instances, sizeof(HostInstance));
+
+    int threads = config->threads > 0 ? config->threads : SDL_GetCPUCount();
+    if (threads > config->instances) {
+        threads = config->instances;
+    }
+
+    printf("Host: %d instances, %u frames each, %d threads\n", config->instances, config->frames, threads);
+
+    SDL_Thread** workers = calloc(threads, sizeof(SDL_Thread*));
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    for (int i = 0; i < threads; i++) {
+        workers[i] = SDL_CreateThread(host_worker, "ves-host-worker", &host);
+        if (workers[i] == NULL) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create worker thread: %s", SDL_GetError());
+            exit(3);
+        }
+    }
+
+    for (int i = 0; i < threads; i++) {
+        SDL_WaitThread(workers[i], NULL);
+    }
+
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    unsigned long total_frames = 0;
+    size_t total_memory = 0;
+    size_t max_memory = 0;
+    int failed = 0;
+    for (int i = 0; i < config->instances; i++) {
+        total_frames += host.instances[i].frames_run;
+        total_memory += host.instances[i].memory;
+        if (host.instances[i].memory > max_memory) {
+            max_memory = host.instances[i].memory;
+        }
+        failed += host.instances[i].failed;
+    }
+
+    double fps = total_frames / seconds;
+    double fps_per_thread = fps / threads;
+
+    printf("Host: %lu frames in %.3f s, %.0f frames/s, %.0f frames/s per thread\n", total_frames, seconds, fps, fps_per_thread);
+    printf("Host: %.1f instances per core at 60 fps\n", fps_per_thread / 60);
+    printf("Host: %zu bytes per instance on average, %zu at most\n", total_memory / config->instances, max_memory);
+    if (failed) {
+        printf("Host: %d instances stopped on a Lua error\n", failed);
+    }
+
+    free(workers);
+    free(host.instances);
+
+    return failed;
+}
@@ -0,0 +1,21 @@
+#ifndef HOST_H
+#define HOST_H
+
+#include "cart.h"
+
+// Host mode: runs many independent headless cart instances over a pool of worker threads
+typedef struct HostConfig {
+    char** filenames; // instances are assigned to these carts round-robin
+    int filename_count;
+    int instances;
+    int threads; // 0 uses one thread per logical CPU
+    unsigned int frames; // frames to run per instance
+    unsigned int delta; // fixed delta passed to _screen_draw, in ms
+    CartOptions options;
+} HostConfig;
+
+// Runs every instance to completion and prints throughput and memory figures.
+// Returns the number of instances that stopped on a Lua error.
+int host_run(const HostConfig* config);
+
+#endif
@@ -0,0 +1,66 @@
+#include "input.h"
+
+Uint8 input_read_keyboard(void) {
+    const Uint8* keys = SDL_GetKeyboardState(NULL);
+    Uint8 buttons = 0;
+
+    buttons |= keys[SDL_SCANCODE_LEFT] << BUTTON_LEFT;
+    buttons |= keys[SDL_SCANCODE_RIGHT] << BUTTON_RIGHT;
+    buttons |= keys[SDL_SCANCODE_UP] << BUTTON_UP;
+    buttons |= keys[SDL_SCANCODE_DOWN] << BUTTON_DOWN;
+    buttons |= (keys[SDL_SCANCODE_Z] | keys[SDL_SCANCODE_C]) << BUTTON_O;
+    buttons |= keys[SDL_SCANCODE_X] << BUTTON_X;
+    buttons |= keys[SDL_SCANCODE_RETURN] << BUTTON_START;
+
+    return buttons;
+}
+
+void input_update(Input* input, Uint8 buttons) {
+    input->pressed |= buttons & ~input->buttons;
+    input->buttons = buttons;
+}
+
+void input_consume(Input* input) {
+    input->pressed = 0;
+}
+
+static int lib_input_check_button(lua_State *L) {
+    int i = luaL_checkinteger(L, 1);
+
+    if (i < 0 || i >= BUTTON_COUNT) {
+        return luaL_error(L, "Input error: button index i out of bound");
+    }
+
+    return i;
+}
+
+// btn(i): true while button i is held
+int lib_input_btn(lua_State *L) {
+    Input* input = lua_touserdata(L, lua_upvalueindex(1));
+    int i = lib_input_check_button(L);
+
+    lua_pushboolean(L, (input->buttons >> i) & 1);
+    return 1;
+}
+
+// btnp(i): true once button i went down, until the callback handling input returns
+int lib_input_btnp(lua_State *L) {
+    Input* input = lua_touserdata(L, lua_upvalueindex(1));
+    int i = lib_input_check_button(L);
+
+    lua_pushboolean(L, (input->pressed >> i) & 1);
+    return 1;
+}
+
+static const luaL_Reg InputLib[] = {
+    {"btn", lib_input_btn},
+    {"btnp", lib_input_btnp},
+    {NULL, NULL}
+};
+
+void input_openlib(lua_State* L, Input* input) {
+    lua_newtable(L);
+    lua_pushlightuserdata(L, input);
+    luaL_setfuncs(L, InputLib, 1);
+    lua_setglobal(L, "NibbleInput");
+}
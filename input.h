@@ -0,0 +1,39 @@
+#ifndef INPUT_H
+#define INPUT_H
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "SDL.h"
+
+typedef enum InputButton {
+    BUTTON_LEFT, // arrow keys
+    BUTTON_RIGHT,
+    BUTTON_UP,
+    BUTTON_DOWN,
+    BUTTON_O, // Z or C
+    BUTTON_X, // X
+    BUTTON_START, // Enter
+    BUTTON_COUNT
+} InputButton;
+
+// Button state of one frame, one bit per InputButton
+typedef struct Input {
+    Uint8 buttons;
+    Uint8 pressed; // went down since the last input_consume, so frames without an update lose no press
+} Input;
+
+// Reads the buttons from the SDL keyboard state. Events must have been pumped this frame.
+Uint8 input_read_keyboard(void);
+
+// Starts a new frame with the given buttons held
+void input_update(Input* input, Uint8 buttons);
+
+// Forgets the presses seen so far, once the callback reading them ran
+void input_consume(Input* input);
+
+// Registers btn and btnp as the NibbleInput global, bound to input
+void input_openlib(lua_State* L, Input* input);
+
+#endif
@@ -0,0 +1,317 @@
+#include "memory.h"
+
+#include <string.h>
+
+static void memory_map(Memory* memory, Uint32 base, Uint32 size, void* data, int raster) {
+    MemoryRegion* region = &memory->regions[memory->region_count++];
+    region->base = base;
+    region->size = size;
+    region->data = data;
+    region->raster = raster;
+}
+
+void memory_init(Memory* memory, Screen* screen) {
+    memset(memory, 0, sizeof(Memory));
+    memory->screen = screen;
+
+    memory_map(memory, MEMORY_SPRITES, MEMORY_RAM_SIZE, memory->ram, 0);
+    memory_map(memory, MEMORY_SCREEN, SCREEN_BUFFER_SIZE, screen->pixels, 0);
+    memory_map(memory, MEMORY_COLORS, sizeof(screen->colors), screen->colors, 0);
+    memory_map(memory, MEMORY_DRAW_PALETTE, sizeof(screen->draw_palette), screen->draw_palette, 0);
+    memory_map(memory, MEMORY_TRANSPARENT, sizeof(screen->transparent), &screen->transparent, 0);
+    memory_map(memory, MEMORY_DISPLAY_PALETTE, sizeof(screen->raster.display), screen->raster.display, 1);
+    memory_map(memory, MEMORY_LINE_PALETTE, sizeof(screen->raster.palette), screen->raster.palette, 1);
+    memory_map(memory, MEMORY_LINE_OFFSET, sizeof(screen->raster.offset), screen->raster.offset, 1);
+    memory_map(memory, MEMORY_ALT_COLORS, sizeof(screen->raster.alt_colors), screen->raster.alt_colors, 1);
+}
+
+void memory_freeze(Memory* memory) {
+    memcpy(memory->rom, memory->ram, MEMORY_RAM_SIZE);
+}
+
+// Region holding address, or NULL in a gap. run is set to the bytes left until the
+// region or the gap ends.
+static MemoryRegion* memory_region(Memory* memory, Uint32 address, Uint32* run) {
+    for (int i = 0; i < memory->region_count; i++) {
+        MemoryRegion* region = &memory->regions[i];
+        if (address < region->base) {
+            *run = region->base - address;
+            return NULL;
+        }
+        if (address < region->base + region->size) {
+            *run = region->base + region->size - address;
+            return region;
+        }
+    }
+
+    *run = MEMORY_SIZE - address;
+    return NULL;
+}
+
+static void memory_touch(Memory* memory, const MemoryRegion* region) {
+    if (region->raster) {
+        memory->screen->raster.active = 1;
+    }
+}
+
+Uint8 memory_peek(Memory* memory, Uint32 address) {
+    Uint32 run;
+    MemoryRegion* region = memory_region(memory, address, &run);
+
+    return region != NULL ? region->data[address - region->base] : 0;
+}
+
+void memory_poke(Memory* memory, Uint32 address, Uint8 value) {
+    Uint32 run;
+    MemoryRegion* region = memory_region(memory, address, &run);
+
+    if (region != NULL) {
+        region->data[address - region->base] = value;
+        memory_touch(memory, region);
+    }
+}
+
+// Copies from host memory, data == NULL writes zeros
+static void memory_write(Memory* memory, Uint32 dest, const Uint8* data, Uint32 size) {
+    while (size > 0) {
+        Uint32 run;
+        MemoryRegion* region = memory_region(memory, dest, &run);
+        Uint32 n = run < size ? run : size;
+
+        if (region != NULL) {
+            if (data != NULL) {
+                memcpy(region->data + dest - region->base, data, n);
+            } else {
+                memset(region->data + dest - region->base, 0, n);
+            }
+            memory_touch(memory, region);
+        }
+
+        dest += n;
+        size -= n;
+        if (data != NULL) {
+            data += n;
+        }
+    }
+}
+
+static void memory_read(Memory* memory, Uint32 src, Uint8* data, Uint32 size) {
+    while (size > 0) {
+        Uint32 run;
+        MemoryRegion* region = memory_region(memory, src, &run);
+        Uint32 n = run < size ? run : size;
+
+        if (region != NULL) {
+            memcpy(data, region->data + src - region->base, n);
+        } else {
+            memset(data, 0, n);
+        }
+
+        src += n;
+        size -= n;
+        data += n;
+    }
+}
+
+void memory_copy(Memory* memory, Uint32 dest, Uint32 src, Uint32 size) {
+    Uint32 dest_run;
+    Uint32 src_run;
+    MemoryRegion* dest_region = memory_region(memory, dest, &dest_run);
+    MemoryRegion* src_region = memory_region(memory, src, &src_run);
+
+    // one region to itself, e.g. scrolling the screen: a single memmove handles any overlap
+    if (dest_region != NULL && dest_region == src_region && size <= dest_run && size <= src_run) {
+        memmove(dest_region->data + dest - dest_region->base, src_region->data + src - src_region->base, size);
+        memory_touch(memory, dest_region);
+        return;
+    }
+
+    if (src + size <= dest || dest + size <= src) {
+        // no overlap: copy region to region in as few pieces as the boundaries allow
+        while (size > 0) {
+            dest_region = memory_region(memory, dest, &dest_run);
+            src_region = memory_region(memory, src, &src_run);
+            Uint32 n = size;
+            n = dest_run < n ? dest_run : n;
+            n = src_run < n ? src_run : n;
+
+            if (dest_region != NULL) {
+                Uint8* to = dest_region->data + dest - dest_region->base;
+                if (src_region != NULL) {
+                    memcpy(to, src_region->data + src - src_region->base, n);
+                } else {
+                    memset(to, 0, n);
+                }
+                memory_touch(memory, dest_region);
+            }
+
+            dest += n;
+            src += n;
+            size -= n;
+        }
+        return;
+    }
+
+    // overlapping and spanning regions: through a buffer on the stack, a chunk at a time,
+    // starting at the end that doesn't overwrite source bytes still to be read
+    Uint8 buffer[MEMORY_COPY_CHUNK];
+    while (size > 0) {
+        Uint32 n = size < MEMORY_COPY_CHUNK ? size : MEMORY_COPY_CHUNK;
+        Uint32 offset = dest < src ? 0 : size - n;
+
+        memory_read(memory, src + offset, buffer, n);
+        memory_write(memory, dest + offset, buffer, n);
+
+        if (dest < src) {
+            dest += n;
+            src += n;
+        }
+        size -= n;
+    }
+}
+
+void memory_set(Memory* memory, Uint32 dest, Uint8 value, Uint32 size) {
+    while (size > 0) {
+        Uint32 run;
+        MemoryRegion* region = memory_region(memory, dest, &run);
+        Uint32 n = run < size ? run : size;
+
+        if (region != NULL) {
+            memset(region->data + dest - region->base, value, n);
+            memory_touch(memory, region);
+        }
+
+        dest += n;
+        size -= n;
+    }
+}
+
+void memory_reload(Memory* memory, Uint32 dest, Uint32 src, Uint32 size) {
+    Uint32 from_rom = src < MEMORY_RAM_SIZE ? MEMORY_RAM_SIZE - src : 0;
+    if (from_rom > size) {
+        from_rom = size;
+    }
+
+    memory_write(memory, dest, memory->rom + src, from_rom);
+    memory_write(memory, dest + from_rom, NULL, size - from_rom);
+}
+
+static Memory* lib_memory(lua_State* L) {
+    return lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// Checks that size bytes at address are within the address space.
+// Compared without adding them up, which could overflow for any size a cart passes.
+static Uint32 lib_memory_range(lua_State* L, lua_Integer address, lua_Integer size) {
+    if (address < 0 || address > MEMORY_SIZE || size < 0 || size > MEMORY_SIZE - address) {
+        luaL_error(L, "Memory error: %I bytes at address %I out of bound", size, address);
+    }
+
+    return address;
+}
+
+// Checks that size bytes at the address in argument arg are within the address space
+static Uint32 lib_memory_address(lua_State* L, int arg, lua_Integer size) {
+    return lib_memory_range(L, luaL_checkinteger(L, arg), size);
+}
+
+// little endian multi-byte values
+static int lib_memory_peekn(lua_State* L, int bytes) {
+    Memory* memory = lib_memory(L);
+    Uint32 address = lib_memory_address(L, 1, bytes);
+    Uint32 value = 0;
+
+    for (int i = 0; i < bytes; i++) {
+        value |= (Uint32) memory_peek(memory, address + i) << (i * 8);
+    }
+
+    lua_pushinteger(L, value);
+    return 1;
+}
+
+static int lib_memory_poken(lua_State* L, int bytes) {
+    Memory* memory = lib_memory(L);
+    Uint32 address = lib_memory_address(L, 1, bytes);
+    Uint32 value = luaL_checkinteger(L, 2);
+
+    for (int i = 0; i < bytes; i++) {
+        memory_poke(memory, address + i, value >> (i * 8));
+    }
+
+    return 0;
+}
+
+static int lib_memory_peek(lua_State* L) {
+    return lib_memory_peekn(L, 1);
+}
+
+static int lib_memory_peek2(lua_State* L) {
+    return lib_memory_peekn(L, 2);
+}
+
+static int lib_memory_peek4(lua_State* L) {
+    return lib_memory_peekn(L, 4);
+}
+
+static int lib_memory_poke(lua_State* L) {
+    return lib_memory_poken(L, 1);
+}
+
+static int lib_memory_poke2(lua_State* L) {
+    return lib_memory_poken(L, 2);
+}
+
+static int lib_memory_poke4(lua_State* L) {
+    return lib_memory_poken(L, 4);
+}
+
+// memcpy(dest, src, len)
+static int lib_memory_memcpy(lua_State* L) {
+    lua_Integer size = luaL_checkinteger(L, 3);
+    Uint32 dest = lib_memory_address(L, 1, size);
+    Uint32 src = lib_memory_address(L, 2, size);
+
+    memory_copy(lib_memory(L), dest, src, size);
+    return 0;
+}
+
+// memset(dest, value, len)
+static int lib_memory_memset(lua_State* L) {
+    lua_Integer size = luaL_checkinteger(L, 3);
+    Uint32 dest = lib_memory_address(L, 1, size);
+    int value = luaL_checkinteger(L, 2);
+
+    memory_set(lib_memory(L), dest, value, size);
+    return 0;
+}
+
+// reload(dest, src, len): copies from the RAM image taken after the main chunk ran.
+// reload() restores all of RAM.
+static int lib_memory_reload(lua_State* L) {
+    lua_Integer size = luaL_optinteger(L, 3, MEMORY_RAM_SIZE);
+    Uint32 dest = lua_isnoneornil(L, 1) ? lib_memory_range(L, 0, size) : lib_memory_address(L, 1, size);
+    Uint32 src = lua_isnoneornil(L, 2) ? lib_memory_range(L, 0, size) : lib_memory_address(L, 2, size);
+
+    memory_reload(lib_memory(L), dest, src, size);
+    return 0;
+}
+
+static const luaL_Reg MemoryLib[] = {
+    {"peek", lib_memory_peek},
+    {"peek2", lib_memory_peek2},
+    {"peek4", lib_memory_peek4},
+    {"poke", lib_memory_poke},
+    {"poke2", lib_memory_poke2},
+    {"poke4", lib_memory_poke4},
+    {"memcpy", lib_memory_memcpy},
+    {"memset", lib_memory_memset},
+    {"reload", lib_memory_reload},
+    {NULL, NULL}
+};
+
+void memory_openlib(lua_State* L, Memory* memory) {
+    lua_newtable(L);
+    lua_pushlightuserdata(L, memory);
+    luaL_setfuncs(L, MemoryLib, 1);
+    lua_setglobal(L, "NibbleMemory");
+}
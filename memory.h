@@ -0,0 +1,68 @@
+#ifndef MEMORY_H
+#define MEMORY_H
+
+#include <lua.h>
+#include <lauxlib.h>
+#include <lualib.h>
+
+#include "SDL.h"
+
+#include "nblscreen.h"
+
+// Flat 64 KB address space of a cart, PICO-8 style. Each region maps straight onto the
+// C field holding it, so the drawing functions and peek/poke see the same bytes.
+#define MEMORY_SIZE 0x10000
+
+#define MEMORY_SPRITES 0x0000 // sprite sheet, 8 KB
+#define MEMORY_MAP 0x2000 // map, 4 KB
+#define MEMORY_GENERAL 0x3000 // general purpose RAM, 12 KB
+#define MEMORY_RAM_SIZE 0x6000 // the three above, restored by reload
+#define MEMORY_SCREEN 0x6000 // Screen.pixels, two pixels per byte, even pixels in the low nibble
+#define MEMORY_COLORS 0x8000 // Screen.colors, 16 times r, g, b
+#define MEMORY_DRAW_PALETTE 0x8030 // pal(c0, c1)
+#define MEMORY_TRANSPARENT 0x8040 // palt mask, 16 bits in host byte order
+#define MEMORY_DISPLAY_PALETTE 0x8050 // pal(c0, c1, 1)
+#define MEMORY_LINE_PALETTE 0x8100 // linepal, one byte per line
+#define MEMORY_LINE_OFFSET 0x8180 // lineoffset, one signed byte per line
+#define MEMORY_ALT_COLORS 0x8200 // palcset, 15 palettes of 16 times r, g, b
+
+#define MEMORY_MAX_REGIONS 16
+#define MEMORY_COPY_CHUNK 256 // bytes moved at a time by memcpy across regions
+
+typedef struct MemoryRegion {
+    Uint32 base;
+    Uint32 size;
+    Uint8* data;
+    int raster; // writes turn on the raster effects of the screen
+} MemoryRegion;
+
+// Unmapped addresses read as 0 and ignore writes
+typedef struct Memory {
+    Screen* screen;
+    MemoryRegion regions[MEMORY_MAX_REGIONS]; // sorted by base
+    int region_count;
+    Uint8 ram[MEMORY_RAM_SIZE];
+    Uint8 rom[MEMORY_RAM_SIZE]; // image of ram taken by memory_freeze, read by reload
+} Memory;
+
+void memory_init(Memory* memory, Screen* screen);
+
+// Takes the current RAM as the image reload copies from, e.g. once the main chunk set up its data
+void memory_freeze(Memory* memory);
+
+Uint8 memory_peek(Memory* memory, Uint32 address);
+
+void memory_poke(Memory* memory, Uint32 address, Uint8 value);
+
+// Both handle overlapping ranges, the whole range has to be within MEMORY_SIZE
+void memory_copy(Memory* memory, Uint32 dest, Uint32 src, Uint32 size);
+
+void memory_set(Memory* memory, Uint32 dest, Uint8 value, Uint32 size);
+
+// Copies from the frozen image of RAM, addresses past MEMORY_RAM_SIZE read as 0
+void memory_reload(Memory* memory, Uint32 dest, Uint32 src, Uint32 size);
+
+// Registers peek, poke, memcpy, memset and reload as the NibbleMemory global, bound to memory
+void memory_openlib(lua_State* L, Memory* memory);
+
+#endif
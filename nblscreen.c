@@ -4,25 +4,19 @@
 
 #include "SDL.h"
 
-Screen* ves_screen;
-
 Screen* screen_init() {
-    // initialize SDL video if it isn't already initialized
-    if (SDL_WasInit(SDL_INIT_VIDEO) == 0) {
-        if (SDL_Init(SDL_INIT_VIDEO) < 0) {
-            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't initialize SDL: %s", SDL_GetError());
-            exit(3);
-        }
-    }
-
     Screen* screen = malloc(sizeof(Screen));
     memset(screen, 0, sizeof(Screen));
 
-    // see here for window flags: https://wiki.libsdl.org/SDL_CreateWindow
-    if (SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, 0, &(screen->window), &(screen->renderer))) {
-        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create window and renderer: %s", SDL_GetError());
-        exit(3);
-    }
+    screen_reset(screen);
+
+    return screen;
+}
+
+void screen_reset(Screen* screen) {
+    memset(screen->colors, 0, sizeof(screen->colors));
+    memset(screen->pixels, 0, sizeof(screen->pixels));
+    memset(&screen->raster, 0, sizeof(ScreenRaster));
 
     // TODO: remove later, set zeroth index as black and first index as red
     screen->colors[0].r = 0x00;
@@ -38,34 +32,63 @@ Screen* screen_init() {
     screen->colors[3].g = 0x00;
     screen->colors[3].b = 0xFF;
 
-    return screen;
+    screen_reset_palettes(screen);
+    screen_camera(screen, 0, 0);
+    screen_clip(screen, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
 }
 
+void screen_reset_palettes(Screen* screen) {
+    for (int i = 0; i < 16; i++) {
+        screen->draw_palette[i] = i;
+        screen->raster.display[i] = i;
+    }
+    screen->transparent = 0;
+}
 
-void screen_free(Screen* screen) {
-    if (screen != NULL) {
-        SDL_DestroyRenderer(screen->renderer);
-        SDL_DestroyWindow(screen->window);
-        free(screen);
+void screen_display_colors(const Screen* screen, Color* colors) {
+    for (int i = 0; i < 16; i++) {
+        colors[i] = screen->colors[screen->raster.active ? screen->raster.display[i] & 0x0F : i];
     }
 }
 
-// Return 0 on success, 1 on failure.
-// The pixel (x2, y2) is inclusive.
-int screen_fill_scanline(Screen* screen, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, Uint8 color) {
-    // TODO: surround this assert in debug
-    assert(color < 16 && x1 < SCREEN_WIDTH && x2 < SCREEN_WIDTH && y1 < SCREEN_HEIGHT && y2 < SCREEN_HEIGHT);
+void screen_open_window(Screen* screen) {
+    // initialize SDL video if it isn't already initialized
+    if (SDL_WasInit(SDL_INIT_VIDEO) == 0) {
+        if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0) {
+            SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't initialize SDL: %s", SDL_GetError());
+            exit(3);
+        }
+    }
+
+    // see here for window flags: https://wiki.libsdl.org/SDL_CreateWindow
+    if (SDL_CreateWindowAndRenderer(SCREEN_WIDTH, SCREEN_HEIGHT, 0, &(screen->window), &(screen->renderer))) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create window and renderer: %s", SDL_GetError());
+        exit(3);
+    }
 
-    int coord_start = (x1 + y1 * SCREEN_WIDTH);
-    int coord_end = (x2 + y2 * SCREEN_WIDTH);
+    // the framebuffer is expanded into this texture and drawn with a single copy
+    screen->texture = SDL_CreateTexture(screen->renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STREAMING, SCREEN_WIDTH, SCREEN_HEIGHT);
+    if (screen->texture == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create screen texture: %s", SDL_GetError());
+        exit(3);
+    }
+}
 
-    if (coord_start > coord_end) {
-        int temp = coord_start;
-        coord_start = coord_end;
-        coord_end = temp;
+void screen_free(Screen* screen) {
+    if (screen != NULL) {
+        if (screen->window != NULL) {
+            SDL_DestroyTexture(screen->texture);
+            SDL_DestroyRenderer(screen->renderer);
+            SDL_DestroyWindow(screen->window);
+        }
+        free(screen);
     }
+}
 
-    // printf("AAAA: %u, %u\n", coord_start, coord_end);
+// Writes the pixels x1 to x2 (inclusive) of line y, already clipped
+static void screen_span(Screen* screen, int x1, int x2, int y, Uint8 color) {
+    int coord_start = x1 + y * SCREEN_WIDTH;
+    int coord_end = x2 + y * SCREEN_WIDTH;
 
     if (coord_start % 2) { // if odd
         screen->pixels[coord_start / 2] = (screen->pixels[coord_start / 2] & 0x0F) | (color << 4);
@@ -80,101 +103,334 @@ int screen_fill_scanline(Screen* screen, unsigned int x1, unsigned int y1, unsig
     if (coord_start <= coord_end) {
         memset(screen->pixels + (coord_start / 2), color | (color << 4), ((coord_end - coord_start) / 2) + 1);
     }
+}
 
-    // printf("(pixel at %u, %u): %x\n", x1, y1, screen->pixels[(x1 + y1 * SCREEN_WIDTH)/ 2]);
-    // printf("(pixel at %u, %u): %x\n", x2, y2, screen->pixels[(x2 + y2 * SCREEN_WIDTH)/ 2]);
+// Span of line y in screen coordinates, clipped
+static void screen_clip_span(Screen* screen, int x1, int x2, int y, Uint8 color) {
+    if (y < screen->clip_y1 || y > screen->clip_y2) {
+        return;
+    }
 
-    return 0;
+    x1 = x1 > screen->clip_x1 ? x1 : screen->clip_x1;
+    x2 = x2 < screen->clip_x2 ? x2 : screen->clip_x2;
+    if (x1 <= x2) {
+        screen_span(screen, x1, x2, y, color);
+    }
 }
 
-int screen_pset(Screen* screen, unsigned int x, unsigned int y, Uint8 color) {
-    // TODO: surround this assert in debug
-    assert(color < 16 && x < SCREEN_WIDTH && y < SCREEN_HEIGHT);
+static void screen_plot(Screen* screen, int x, int y, Uint8 color) {
     const int coord = (x + y * SCREEN_WIDTH);
     const Uint8 pixel = screen->pixels[coord / 2];
     screen->pixels[coord / 2] = coord % 2 ? ((pixel & 0x0F) | (color << 4)) : ((pixel & 0xF0) | (color));
+}
+
+static Sint64 screen_clamp_coordinate(Sint64 v) {
+    return v < -SCREEN_COORD_LIMIT ? -SCREEN_COORD_LIMIT : v > SCREEN_COORD_LIMIT ? SCREEN_COORD_LIMIT : v;
+}
+
+// Coordinates with the camera applied, worked out in 64 bits since both come from the cart
+static int screen_view_x(const Screen* screen, int x) {
+    return screen_clamp_coordinate((Sint64) x - screen->camera_x);
+}
+
+static int screen_view_y(const Screen* screen, int y) {
+    return screen_clamp_coordinate((Sint64) y - screen->camera_y);
+}
+
+void screen_camera(Screen* screen, int x, int y) {
+    screen->camera_x = x;
+    screen->camera_y = y;
+}
+
+void screen_clip(Screen* screen, int x, int y, int w, int h) {
+    // an empty rectangle ends up with x2 < x1 or y2 < y1
+    Sint64 x2 = (Sint64) x + w - 1;
+    Sint64 y2 = (Sint64) y + h - 1;
+
+    screen->clip_x1 = x < 0 ? 0 : x > SCREEN_WIDTH ? SCREEN_WIDTH : x;
+    screen->clip_y1 = y < 0 ? 0 : y > SCREEN_HEIGHT ? SCREEN_HEIGHT : y;
+    screen->clip_x2 = x2 < -1 ? -1 : x2 > SCREEN_WIDTH - 1 ? SCREEN_WIDTH - 1 : x2;
+    screen->clip_y2 = y2 < -1 ? -1 : y2 > SCREEN_HEIGHT - 1 ? SCREEN_HEIGHT - 1 : y2;
+}
+
+// Return 0 on success, 1 if nothing was drawn.
+// Fills pixels in reading order from (x1, y1) to (x2, y2) inclusive, wrapping from one line to the next.
+int screen_fill_scanline(Screen* screen, int x1, int y1, int x2, int y2, Uint8 color) {
+    assert(color < 16);
+
+    x1 = screen_view_x(screen, x1);
+    x2 = screen_view_x(screen, x2);
+    y1 = screen_view_y(screen, y1);
+    y2 = screen_view_y(screen, y2);
+
+    if (y1 > y2 || (y1 == y2 && x1 > x2)) {
+        int temp = x1;
+        x1 = x2;
+        x2 = temp;
+        temp = y1;
+        y1 = y2;
+        y2 = temp;
+    }
+
+    if (y2 < screen->clip_y1 || y1 > screen->clip_y2) {
+        return 1;
+    }
+
+    for (int y = y1 > screen->clip_y1 ? y1 : screen->clip_y1; y <= y2 && y <= screen->clip_y2; y++) {
+        screen_clip_span(screen, y == y1 ? x1 : 0, y == y2 ? x2 : SCREEN_WIDTH - 1, y, color);
+    }
+
+    return 0;
+}
+
+int screen_pset(Screen* screen, int x, int y, Uint8 color) {
+    // TODO: surround this assert in debug
+    assert(color < 16);
 
+    x = screen_view_x(screen, x);
+    y = screen_view_y(screen, y);
+
+    if (x < screen->clip_x1 || x > screen->clip_x2 || y < screen->clip_y1 || y > screen->clip_y2) {
+        return 1;
+    }
+
+    screen_plot(screen, x, y, color);
     return 0;
 }
 
-// (x2, y2) is inclusive
-int screen_rectfill(Screen* screen, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, Uint8 color) {
-    assert(color < 16 && x1 < SCREEN_WIDTH && x2 < SCREEN_WIDTH && y1 < SCREEN_HEIGHT && y2 < SCREEN_HEIGHT);
+// (x2, y2) is inclusive, the corners can be given in any order
+int screen_rectfill(Screen* screen, int x1, int y1, int x2, int y2, Uint8 color) {
+    assert(color < 16);
+
+    int left = screen_view_x(screen, x1 < x2 ? x1 : x2);
+    int right = screen_view_x(screen, x1 < x2 ? x2 : x1);
+    int top = screen_view_y(screen, y1 < y2 ? y1 : y2);
+    int bottom = screen_view_y(screen, y1 < y2 ? y2 : y1);
+
+    left = left > screen->clip_x1 ? left : screen->clip_x1;
+    right = right < screen->clip_x2 ? right : screen->clip_x2;
+    top = top > screen->clip_y1 ? top : screen->clip_y1;
+    bottom = bottom < screen->clip_y2 ? bottom : screen->clip_y2;
+
+    if (left > right || top > bottom) {
+        return 1;
+    }
 
-    for (int y = y1; y <= y2; y++) {
-        screen_fill_scanline(screen, x1, y, x2, y, color);
+    for (int y = top; y <= bottom; y++) {
+        screen_span(screen, left, right, y, color);
     }
 
     return 0;
 }
 
-int screen_line(Screen* screen, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, Uint8 color) {
-    assert(color < 16 && x1 < SCREEN_WIDTH && x2 < SCREEN_WIDTH && y1 < SCREEN_HEIGHT && y2 < SCREEN_HEIGHT);
-    
+// Cohen-Sutherland outcode of a point against the clip rectangle
+static int screen_outcode(const Screen* screen, Sint64 x, Sint64 y) {
+    return (x < screen->clip_x1) | (x > screen->clip_x2) << 1 | (y < screen->clip_y1) << 2 | (y > screen->clip_y2) << 3;
+}
+
+// Moves the end points of a line onto the clip rectangle. Returns 0 if it misses it.
+static int screen_clip_line(const Screen* screen, Sint64* x1, Sint64* y1, Sint64* x2, Sint64* y2) {
+    int out1 = screen_outcode(screen, *x1, *y1);
+    int out2 = screen_outcode(screen, *x2, *y2);
+
+    while (out1 | out2) {
+        if (out1 & out2) {
+            return 0;
+        }
+
+        int out = out1 ? out1 : out2;
+        Sint64 x;
+        Sint64 y;
+
+        if (out & 8) {
+            y = screen->clip_y2;
+            x = *x1 + (*x2 - *x1) * (y - *y1) / (*y2 - *y1);
+        } else if (out & 4) {
+            y = screen->clip_y1;
+            x = *x1 + (*x2 - *x1) * (y - *y1) / (*y2 - *y1);
+        } else if (out & 2) {
+            x = screen->clip_x2;
+            y = *y1 + (*y2 - *y1) * (x - *x1) / (*x2 - *x1);
+        } else {
+            x = screen->clip_x1;
+            y = *y1 + (*y2 - *y1) * (x - *x1) / (*x2 - *x1);
+        }
+
+        if (out == out1) {
+            *x1 = x;
+            *y1 = y;
+            out1 = screen_outcode(screen, x, y);
+        } else {
+            *x2 = x;
+            *y2 = y;
+            out2 = screen_outcode(screen, x, y);
+        }
+    }
+
+    return 1;
+}
+
+int screen_line(Screen* screen, int x1, int y1, int x2, int y2, Uint8 color) {
+    assert(color < 16);
+
+    // clamped so the products of screen_clip_line stay within 64 bits, which only
+    // bends lines reaching a billion pixels away
+    Sint64 cx1 = screen_clamp_coordinate((Sint64) x1 - screen->camera_x);
+    Sint64 cy1 = screen_clamp_coordinate((Sint64) y1 - screen->camera_y);
+    Sint64 cx2 = screen_clamp_coordinate((Sint64) x2 - screen->camera_x);
+    Sint64 cy2 = screen_clamp_coordinate((Sint64) y2 - screen->camera_y);
+
+    int out1 = screen_outcode(screen, cx1, cy1);
+    int out2 = screen_outcode(screen, cx2, cy2);
+    if (out1 & out2) {
+        return 1;
+    }
+
+    // Lines reaching past the clip rectangle are drawn pixel by pixel with a check,
+    // so they keep the exact pixels of the unclipped line. Only lines long enough for
+    // that to matter get their end points moved, at the cost of the slope rounding.
+    int checked = out1 | out2;
+    Sint64 width = cx2 > cx1 ? cx2 - cx1 : cx1 - cx2;
+    Sint64 height = cy2 > cy1 ? cy2 - cy1 : cy1 - cy2;
+    if (checked && (width > 4 * SCREEN_WIDTH || height > 4 * SCREEN_HEIGHT)) {
+        if (!screen_clip_line(screen, &cx1, &cy1, &cx2, &cy2)) {
+            return 1;
+        }
+        checked = 0;
+    }
+
     // Bresenham's line algorithm because I'm too lazy to reinvent the wheel
-    int dx = abs(x2 - x1);
-    int dy = -abs(y2 - y1);
-    
-    int sx = x1 < x2 ? 1 : -1;
-    int sy = y1 < y2 ? 1 : -1;
+    int px = cx1;
+    int py = cy1;
+    int ex = cx2;
+    int ey = cy2;
+    int dx = abs(ex - px);
+    int dy = -abs(ey - py);
 
-    int err = dx + dy;
+    int sx = px < ex ? 1 : -1;
+    int sy = py < ey ? 1 : -1;
 
-    // printf("x1, y1, x2, y2: %u, %u, %u, %u\n", x1, y1, x2, y2);
+    int err = dx + dy;
+    int entered = 0;
 
     while (1) {
-        // printf("x1, y1: %u, %u\n", x1, y1);
-        if (x1 > x2 || y1 > y2) {
-            screen_pset(screen, x2, y2, color);
-            break;
+        // past the end point in x or y, the line ends on it
+        int past = px > ex || py > ey;
+        int x = past ? ex : px;
+        int y = past ? ey : py;
+
+        if (!checked) {
+            screen_plot(screen, x, y, color);
+        } else if (x >= screen->clip_x1 && x <= screen->clip_x2 && y >= screen->clip_y1 && y <= screen->clip_y2) {
+            screen_plot(screen, x, y, color);
+            entered = 1;
+        } else if (entered) {
+            break; // a line leaves the rectangle only once
         }
-        screen_pset(screen, x1, y1, color);
-        if (x1 == x2 && y1 == y2) { break; }
+        if (past || (px == ex && py == ey)) { break; }
 
         if (2 * err >= dy) {
             err += dy;
-            x1 += sx;
+            px += sx;
         }
 
         if (2 * err <= dx) {
             err += dx;
-            y1 += sy;
+            py += sy;
         }
     }
 
-    return 1;
+    return 0;
 }
 
-void screen_blit(Screen* screen) {
-    Uint8 byte;
-    Uint8 pixel;
-    Color color;
-    SDL_Rect rect;
-    rect.x = 0;
-    rect.y = 0;
-    rect.h = 1;
-    rect.w = 1;
-
-    for (int x = 0; x < SCREEN_WIDTH; x++) {
+static Uint32 screen_texel(Color color) {
+    return 0xFF000000 | (color.r << 16) | (color.g << 8) | color.b;
+}
+
+Uint64 screen_blit_pixels(Screen* screen, const Uint8* pixels, const Color* colors, const ScreenRaster* raster) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Uint32 palettes[1 + SCREEN_ALT_PALETTES][16];
+    int palette_count = raster->active ? 1 + SCREEN_ALT_PALETTES : 1;
+    void* texels;
+    int pitch;
+
+    for (int i = 0; i < 16; i++) {
+        palettes[0][i] = screen_texel(colors[raster->active ? raster->display[i] & 0x0F : i]);
+    }
+    for (int p = 1; p < palette_count; p++) {
+        for (int i = 0; i < 16; i++) {
+            palettes[p][i] = screen_texel(raster->alt_colors[p - 1][raster->display[i] & 0x0F]);
+        }
+    }
+
+    if (SDL_LockTexture(screen->texture, NULL, &texels, &pitch) == 0) {
+        // even pixels are in the low nibble
         for (int y = 0; y < SCREEN_HEIGHT; y++) {
-            // get the byte that the nibble is in
-            byte = (screen->pixels[(x + y * SCREEN_WIDTH) / 2]);
-            // read the nibble
-            pixel = ((x + y * SCREEN_WIDTH) % 2) ? byte >> 4 : byte & 0x0F;
-
-            /* if (x < 7 && y < 1) {
-                printf("(%u, %u): %u\n", x, y, pixel);
-            } */
-
-            assert(pixel < 16); // TODO: surround with debug later
-            color = screen->colors[pixel];
-            SDL_SetRenderDrawColor(screen->renderer, color.r, color.g, color.b, SDL_ALPHA_OPAQUE);
-
-            rect.x = x;
-            rect.y = y;
-            SDL_RenderFillRect(screen->renderer, &rect);
+            Uint32* row = (Uint32*) ((Uint8*) texels + y * pitch);
+            const Uint8* source = pixels + y * SCREEN_WIDTH / 2;
+            const Uint32* palette = palettes[0];
+            int offset = 0;
+
+            if (raster->active) {
+                palette = palettes[raster->palette[y] < palette_count ? raster->palette[y] : 0];
+                offset = raster->offset[y];
+            }
+
+            if (offset == 0) {
+                for (int x = 0; x < SCREEN_WIDTH / 2; x++) {
+                    row[x * 2] = palette[source[x] & 0x0F];
+                    row[x * 2 + 1] = palette[source[x] >> 4];
+                }
+            } else {
+                // screen x comes from source x - offset, wrapped around
+                int from = ((-offset) % SCREEN_WIDTH + SCREEN_WIDTH) % SCREEN_WIDTH;
+                for (int x = 0; x < SCREEN_WIDTH; x++) {
+                    Uint8 byte = source[from / 2];
+                    row[x] = palette[from % 2 ? byte >> 4 : byte & 0x0F];
+                    if (++from == SCREEN_WIDTH) {
+                        from = 0;
+                    }
+                }
+            }
         }
+        SDL_UnlockTexture(screen->texture);
+    }
+
+    SDL_RenderCopy(screen->renderer, screen->texture, NULL, NULL);
+
+    return SDL_GetPerformanceCounter() - start;
+}
+
+void screen_blit(Screen* screen) {
+    screen->stats.blit_ticks += screen_blit_pixels(screen, screen->pixels, screen->colors, &screen->raster);
+}
+
+void screen_stats_rollover(Screen* screen) {
+    screen->last_stats = screen->stats;
+    memset(&screen->stats, 0, sizeof(ScreenStats));
+}
+
+static Screen* lib_screen(lua_State *L) {
+    return lua_touserdata(L, lua_upvalueindex(1));
+}
+
+// Applies the draw palette to a color argument. Returns 0 if the color is transparent:
+// primitives draw in a single color, so the caller leaves out the whole primitive.
+static int lib_screen_color(Screen* screen, int c, Uint8* color) {
+    *color = screen->draw_palette[c] & 0x0F; // poke can put anything there
+    return !(screen->transparent & (1 << c));
+}
+
+// Reading the counter costs more than a pset, so calls are only timed when asked to
+static Uint64 lib_screen_start(Screen* screen) {
+    return screen->timed ? SDL_GetPerformanceCounter() : 0;
+}
+
+static void lib_screen_count(Screen* screen, ScreenPrim prim, Uint64 start) {
+    if (screen->timed) {
+        screen->stats.raster_ticks += SDL_GetPerformanceCounter() - start;
     }
+    screen->stats.calls[prim]++;
 }
 
 int lib_screen_pset(lua_State *L) {
@@ -182,13 +438,17 @@ int lib_screen_pset(lua_State *L) {
     int y = luaL_checkinteger(L, 2);
     int c = luaL_checkinteger(L, 3);
 
-    if (x < 0 || x >= SCREEN_WIDTH || y < 0 || y >= SCREEN_HEIGHT) {
-        return luaL_error(L, "Screen error: pset coordinate (x,y) out of bound");
-    } else if (c < 0 || c >= 16) {
+    if (c < 0 || c >= 16) {
         return luaL_error(L, "Screen error: pset color index c out of bound");
     }
 
-    screen_pset(ves_screen, x, y, c);
+    Screen* screen = lib_screen(L);
+    Uint8 color;
+    Uint64 start = lib_screen_start(screen);
+    if (lib_screen_color(screen, c, &color)) {
+        screen_pset(screen, x, y, color);
+    }
+    lib_screen_count(screen, SCREEN_PRIM_PSET, start);
     return 1;
 }
 
@@ -199,15 +459,17 @@ int lib_screen_rectfill(lua_State *L) {
     int y2 = luaL_checkinteger(L, 4);
     int c = luaL_checkinteger(L, 5);
 
-    if (x1 < 0 || x1 >= SCREEN_WIDTH || y1 < 0 || y1 >= SCREEN_HEIGHT) {
-        return luaL_error(L, "Screen error: rectfill coordinate (x1,y1) out of bound");
-    } else if (x2 < 0 || x2 >= SCREEN_WIDTH || y2 < 0 || y2 >= SCREEN_HEIGHT) {
-        return luaL_error(L, "Screen error: rectfill coordinate (x2,y2) out of bound");
-    } else if (c < 0 || c >= 16) {
+    if (c < 0 || c >= 16) {
         return luaL_error(L, "Screen error: rectfill color index c out of bound");
     }
 
-    screen_rectfill(ves_screen, x1, y1, x2, y2, c);
+    Screen* screen = lib_screen(L);
+    Uint8 color;
+    Uint64 start = lib_screen_start(screen);
+    if (lib_screen_color(screen, c, &color)) {
+        screen_rectfill(screen, x1, y1, x2, y2, color);
+    }
+    lib_screen_count(screen, SCREEN_PRIM_RECTFILL, start);
     return 1;
 }
 
@@ -220,15 +482,17 @@ int lib_screen_line(lua_State *L) {
     int y2 = luaL_checkinteger(L, 4);
     int c = luaL_checkinteger(L, 5);
 
-    if (x1 < 0 || x1 >= SCREEN_WIDTH || y1 < 0 || y1 >= SCREEN_HEIGHT) {
-        return luaL_error(L, "Screen error: line coordinate (x1,y1) out of bound");
-    } else if (x2 < 0 || x2 >= SCREEN_WIDTH || y2 < 0 || y2 >= SCREEN_HEIGHT) {
-        return luaL_error(L, "Screen error: line coordinate (x2,y2) out of bound");
-    } else if (c < 0 || c >= 16) {
+    if (c < 0 || c >= 16) {
         return luaL_error(L, "Screen error: line color index c out of bound");
     }
 
-    screen_line(ves_screen, x1, y1, x2, y2, c);
+    Screen* screen = lib_screen(L);
+    Uint8 color;
+    Uint64 start = lib_screen_start(screen);
+    if (lib_screen_color(screen, c, &color)) {
+        screen_line(screen, x1, y1, x2, y2, color);
+    }
+    lib_screen_count(screen, SCREEN_PRIM_LINE, start);
     return 1;
 }
 
@@ -246,19 +510,174 @@ int lib_screen_cset(lua_State *L) {
         return luaL_error(L, "Screen error: cset color index c out of bound");
     }
 
-    ves_screen->colors[c].r = r;
-    ves_screen->colors[c].g = g;
-    ves_screen->colors[c].b = b;
+    Screen* screen = lib_screen(L);
+    screen->colors[c].r = r;
+    screen->colors[c].g = g;
+    screen->colors[c].b = b;
 
     // printf("%u, %u, %u\n", screen->colors[c].r , screen->colors[c].g , screen->colors[c].b );
 
     return 1;
 }
 
+// linepal(y, p): shows line y in palette p, 0 being the one set with cset
+int lib_screen_linepal(lua_State *L) {
+    int y = luaL_checkinteger(L, 1);
+    int p = luaL_checkinteger(L, 2);
+
+    if (y < 0 || y >= SCREEN_HEIGHT) {
+        return luaL_error(L, "Screen error: linepal line y out of bound");
+    } else if (p < 0 || p > SCREEN_ALT_PALETTES) {
+        return luaL_error(L, "Screen error: linepal palette p out of bound");
+    }
+
+    Screen* screen = lib_screen(L);
+    screen->raster.palette[y] = p;
+    screen->raster.active = 1;
+
+    return 0;
+}
+
+// lineoffset(y, dx): shifts line y right by dx pixels when displayed, wrapping around
+int lib_screen_lineoffset(lua_State *L) {
+    int y = luaL_checkinteger(L, 1);
+    int dx = luaL_checkinteger(L, 2);
+
+    if (y < 0 || y >= SCREEN_HEIGHT) {
+        return luaL_error(L, "Screen error: lineoffset line y out of bound");
+    } else if (dx < -SCREEN_WIDTH || dx > SCREEN_WIDTH) {
+        return luaL_error(L, "Screen error: lineoffset offset dx out of bound");
+    }
+
+    Screen* screen = lib_screen(L);
+    screen->raster.offset[y] = dx % SCREEN_WIDTH;
+    screen->raster.active = 1;
+
+    return 0;
+}
+
+// palcset(p, c, r, g, b): cset for palette p of linepal
+int lib_screen_palcset(lua_State *L) {
+    int p = luaL_checkinteger(L, 1);
+    int c = luaL_checkinteger(L, 2);
+    int r = luaL_checkinteger(L, 3);
+    int g = luaL_checkinteger(L, 4);
+    int b = luaL_checkinteger(L, 5);
+
+    if (p < 1 || p > SCREEN_ALT_PALETTES) {
+        return luaL_error(L, "Screen error: palcset palette p out of bound");
+    } else if (c < 0 || c >= 16) {
+        return luaL_error(L, "Screen error: palcset color index c out of bound");
+    } else if (r < 0 || r >= 256 || g < 0 || g >= 256 || b < 0 || b >= 256) {
+        return luaL_error(L, "Screen error: palcset color (r, g, b) out of bound");
+    }
+
+    Screen* screen = lib_screen(L);
+    Color* color = &screen->raster.alt_colors[p - 1][c];
+    color->r = r;
+    color->g = g;
+    color->b = b;
+    screen->raster.active = 1;
+
+    return 0;
+}
+
+// pal(c0, c1, p): draws color c0 as c1 from now on, or with p = 1 displays color c0 as c1
+// pal(): resets both palettes and transparency
+int lib_screen_pal(lua_State *L) {
+    Screen* screen = lib_screen(L);
+
+    if (lua_gettop(L) == 0) {
+        screen_reset_palettes(screen);
+        return 0;
+    }
+
+    int c0 = luaL_checkinteger(L, 1);
+    int c1 = luaL_checkinteger(L, 2);
+    int p = luaL_optinteger(L, 3, 0);
+
+    if (c0 < 0 || c0 >= 16 || c1 < 0 || c1 >= 16) {
+        return luaL_error(L, "Screen error: pal color index out of bound");
+    } else if (p != 0 && p != 1) {
+        return luaL_error(L, "Screen error: pal palette p must be 0 (draw) or 1 (display)");
+    }
+
+    if (p == 0) {
+        screen->draw_palette[c0] = c1;
+    } else {
+        screen->raster.display[c0] = c1;
+        screen->raster.active = 1;
+    }
+
+    return 0;
+}
+
+// palt(c, t): makes color c transparent to drawing if t is true or a number other than 0,
+// opaque otherwise. palt() makes every color opaque
+int lib_screen_palt(lua_State *L) {
+    Screen* screen = lib_screen(L);
+
+    if (lua_gettop(L) == 0) {
+        screen->transparent = 0;
+        return 0;
+    }
+
+    int c = luaL_checkinteger(L, 1);
+    luaL_checkany(L, 2);
+
+    if (c < 0 || c >= 16) {
+        return luaL_error(L, "Screen error: palt color index c out of bound");
+    }
+
+    // 0 is true in Lua, but palt(c, 0) makes a color opaque as in PICO-8
+    int transparent = lua_type(L, 2) == LUA_TNUMBER ? lua_tonumber(L, 2) != 0 : lua_toboolean(L, 2);
+
+    if (transparent) {
+        screen->transparent |= 1 << c;
+    } else {
+        screen->transparent &= ~(1 << c);
+    }
+
+    return 0;
+}
+
+// camera(x, y): subtracts (x, y) from the coordinates of pset, rectfill and line, camera() resets it
+int lib_screen_camera(lua_State *L) {
+    screen_camera(lib_screen(L), luaL_optinteger(L, 1, 0), luaL_optinteger(L, 2, 0));
+    return 0;
+}
+
+// clip(x, y, w, h): draws only within the rectangle, clip() draws to the whole screen again
+int lib_screen_clip(lua_State *L) {
+    Screen* screen = lib_screen(L);
+
+    if (lua_gettop(L) == 0) {
+        screen_clip(screen, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        return 0;
+    }
+
+    screen_clip(screen, luaL_checkinteger(L, 1), luaL_checkinteger(L, 2), luaL_checkinteger(L, 3), luaL_checkinteger(L, 4));
+    return 0;
+}
+
 const luaL_Reg ScreenLib[] = {
     {"pset", lib_screen_pset},
     {"rectfill", lib_screen_rectfill},
     {"line", lib_screen_line},
     {"cset", lib_screen_cset},
+    {"linepal", lib_screen_linepal},
+    {"lineoffset", lib_screen_lineoffset},
+    {"palcset", lib_screen_palcset},
+    {"pal", lib_screen_pal},
+    {"palt", lib_screen_palt},
+    {"camera", lib_screen_camera},
+    {"clip", lib_screen_clip},
     {NULL, NULL}
-};
\ No newline at end of file
+};
+
+void screen_openlib(lua_State* L, Screen* screen) {
+    lua_newtable(L);
+    lua_pushlightuserdata(L, screen);
+    luaL_setfuncs(L, ScreenLib, 1);
+    lua_setglobal(L, "NibbleScreen");
+}
\ No newline at end of file
@@ -11,40 +11,119 @@
 #define SCREEN_HEIGHT 128
 #define SCREEN_SCALE_RATIO 3 // TODO: implement screen_scale_ratio. Not gonna do it now to minimize potential for bugs
 
+// the monster expression is equivalent to ceildivide by 2
+// each pixel takes up a nibble
+#define SCREEN_BUFFER_SIZE (1 + (((SCREEN_WIDTH * SCREEN_HEIGHT) - 1) / 2))
+#define SCREEN_COORD_LIMIT (1 << 30) // coordinates are clamped to this far from the screen, camera applied
+
 typedef struct Color {
     Uint8 r;
     Uint8 g;
     Uint8 b;
 } Color;
 
+// Lua-facing drawing primitives, for per-frame call counts
+typedef enum ScreenPrim {
+    SCREEN_PRIM_PSET,
+    SCREEN_PRIM_RECTFILL,
+    SCREEN_PRIM_LINE,
+    SCREEN_PRIM_COUNT
+} ScreenPrim;
+
+typedef struct ScreenStats {
+    Uint64 raster_ticks; // performance counter ticks spent in drawing primitives, when timed
+    Uint64 blit_ticks;
+    unsigned int calls[SCREEN_PRIM_COUNT];
+} ScreenStats;
+
+#define SCREEN_ALT_PALETTES 15
+
+// Effects applied when the framebuffer is expanded to colors, so fades, gradients
+// and wavy distortion cost nothing while drawing
+typedef struct ScreenRaster {
+    Uint8 display[16]; // color i of the framebuffer is shown as color display[i] of the line's palette
+    Uint8 palette[SCREEN_HEIGHT]; // 0 shows the line in Screen.colors, n in alt_colors[n - 1]
+    Sint8 offset[SCREEN_HEIGHT]; // pixels the line is shifted right by, wrapping around
+    Color alt_colors[SCREEN_ALT_PALETTES][16];
+    int active; // set once a cart touches the tables, until then the blit takes the plain path
+} ScreenRaster;
+
 typedef struct Screen {
     Color colors[16];
 
-    // the monster expression is equivalent to ceildivide by 2
-    // each pixel takes up a nibble
-    Uint8 pixels[1 + (((SCREEN_WIDTH * SCREEN_HEIGHT) - 1) / 2)]; 
-    SDL_Window *window;
+    Uint8 pixels[SCREEN_BUFFER_SIZE];
+    ScreenRaster raster;
+
+    // applied by the drawing functions of ScreenLib to their color argument
+    Uint8 draw_palette[16]; // color c is drawn as draw_palette[c]
+    Uint16 transparent; // bit c set: color c isn't drawn at all
+
+    // applied by the drawing primitives: the camera is subtracted from every coordinate,
+    // then anything outside the clip rectangle is left out
+    int camera_x;
+    int camera_y;
+    int clip_x1;
+    int clip_y1;
+    int clip_x2; // inclusive
+    int clip_y2;
+
+    SDL_Window *window; // NULL when running headless
     SDL_Renderer *renderer;
+    SDL_Texture *texture; // streaming copy of the framebuffer in window colors
     SDL_Surface *surface;
-    struct timeval tv_draw;
+
+    ScreenStats stats; // frame being drawn
+    ScreenStats last_stats; // last complete frame
+    int timed; // primitives add the time they take to raster_ticks, two counter reads a call
 } Screen;
 
+// ScreenLib functions take the Screen they draw to as their first upvalue
 extern const luaL_Reg ScreenLib[];
 
-extern Screen* ves_screen;
-
+// Allocates a headless screen. Call screen_open_window to display it.
 Screen* screen_init();
 
+void screen_open_window(Screen* screen);
+
+// Back to the blank screen of screen_init: pixels, colors, palettes, raster tables, camera and clip.
+// The window is kept.
+void screen_reset(Screen* screen);
+
+// Registers ScreenLib as the NibbleScreen global, bound to screen
+void screen_openlib(lua_State* L, Screen* screen);
+
 void screen_free(Screen* screen);
 
-int screen_fill_scanline(Screen* screen, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, Uint8 color);
+// Resets the draw and display palettes to identity and makes every color opaque
+void screen_reset_palettes(Screen* screen);
+
+// The 16 colors as displayed, through the display palette
+void screen_display_colors(const Screen* screen, Color* colors);
+
+// Sets the offset subtracted from the coordinates of the drawing primitives
+void screen_camera(Screen* screen, int x, int y);
 
-int screen_rectfill(Screen* screen, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, Uint8 color);
+// Restricts drawing to the w by h rectangle at (x, y), within the screen
+void screen_clip(Screen* screen, int x, int y, int w, int h);
 
-int screen_line(Screen* screen, unsigned int x1, unsigned int y1, unsigned int x2, unsigned int y2, Uint8 color);
+// The drawing primitives take coordinates before the camera and draw nothing outside the clip
+// rectangle. They return 1 when nothing was drawn.
+int screen_fill_scanline(Screen* screen, int x1, int y1, int x2, int y2, Uint8 color);
 
+int screen_rectfill(Screen* screen, int x1, int y1, int x2, int y2, Uint8 color);
+
+int screen_line(Screen* screen, int x1, int y1, int x2, int y2, Uint8 color);
+
+// Draws the framebuffer to the window renderer
 void screen_blit(Screen* screen);
 
+// Draws a framebuffer other than the screen's own, e.g. one handed over by another thread.
+// Doesn't touch the stats, returns the performance counter ticks it took instead.
+Uint64 screen_blit_pixels(Screen* screen, const Uint8* pixels, const Color* colors, const ScreenRaster* raster);
+
+// Moves the stats of the frame being drawn to last_stats and starts counting a new frame
+void screen_stats_rollover(Screen* screen);
+
 int lib_screen_pset(lua_State *L);
 
 int lib_screen_rectfill(lua_State *L);
@@ -53,6 +132,20 @@ int lib_screen_line(lua_State *L);
 
 int lib_screen_cset(lua_State *L);
 
-int screen_pset(Screen* screen, unsigned int x, unsigned int y, Uint8 color);
+int lib_screen_linepal(lua_State *L);
+
+int lib_screen_lineoffset(lua_State *L);
+
+int lib_screen_palcset(lua_State *L);
+
+int lib_screen_pal(lua_State *L);
+
+int lib_screen_palt(lua_State *L);
+
+int lib_screen_camera(lua_State *L);
+
+int lib_screen_clip(lua_State *L);
+
+int screen_pset(Screen* screen, int x, int y, Uint8 color);
 
 #endif
\ No newline at end of file
@@ -0,0 +1,83 @@
+#!/bin/sh
+# Optimized builds of vesemu, compared.
+#
+# Builds vesemu four ways, all with --buildtype=release (-O3) and the bundled Lua:
+#   build-o3      plain -O3
+#   build-lto     LTO across vesemu and Lua
+#   build-native  LTO and -Dnative=true
+#   build-pgo     LTO and a profile, from an instrumented build trained by running script.lua
+#                 and the carts in bench/ headless
+# then runs every cart RUNS times on each build, interleaving the builds so a slow spell of
+# the machine hits all of them, and reports the median frames per second. Extra arguments go
+# to every meson setup.
+set -e
+
+FRAMES=${FRAMES:-2000} # per cart and run, for training and for the report
+RUNS=${RUNS:-5} # runs of every cart on every build
+CARTS="script.lua bench/*.lua"
+BUILDS="o3 lto native pgo"
+SETUP="--buildtype=release --force-fallback-for=lua-5.4"
+
+cd "$(dirname "$0")"
+rm -rf build-o3 build-lto build-native build-pgo
+
+meson setup build-o3 $SETUP "$@"
+meson setup build-lto $SETUP -Db_lto=true "$@"
+meson setup build-native $SETUP -Db_lto=true -Dnative=true "$@"
+meson setup build-pgo $SETUP -Db_lto=true -Db_pgo=generate "$@"
+for build in $BUILDS; do
+    meson compile -C "build-$build" vesemu
+done
+
+for cart in $CARTS; do
+    echo "Training on $cart"
+    build-pgo/vesemu --headless --frames "$FRAMES" --delta 16 "$cart" > /dev/null
+done
+meson configure build-pgo -Db_pgo=use
+meson compile -C build-pgo vesemu
+
+# frames per second of one single-threaded run, 0 if it didn't report any
+fps() {
+    value=$("$1" --host 1 --threads 1 --frames "$FRAMES" "$2" | sed -n 's/^Host: .* s, \([0-9]*\) frames\/s,.*/\1/p')
+    if [ -z "$value" ]; then
+        echo "! $1 $2 reported no frame rate" >&2
+        value=0
+    fi
+    echo "$value"
+}
+
+results=$(mktemp)
+trap 'rm -f "$results"' EXIT
+
+run=1
+while [ "$run" -le "$RUNS" ]; do
+    echo "Run $run of $RUNS"
+    for cart in $CARTS; do
+        for build in $BUILDS; do
+            echo "$cart $build $(fps "build-$build/vesemu" "$cart")" >> "$results"
+        done
+    done
+    run=$((run + 1))
+done
+
+median() {
+    awk -v cart="$1" -v build="$2" '$1 == cart && $2 == build { print $3 }' "$results" | sort -n |
+        awk '{ v[NR] = $1 } END { print NR % 2 ? v[(NR + 1) / 2] : int((v[NR / 2] + v[NR / 2 + 1]) / 2) }'
+}
+
+echo
+echo "Median frames per second of $RUNS runs, and the speedup of each build over o3"
+printf "%-24s %10s %10s %10s %10s %7s %7s %7s\n" "Cart" "o3" "lto" "native" "pgo" "lto" "native" "pgo"
+for cart in $CARTS; do
+    o3=$(median "$cart" o3)
+    lto=$(median "$cart" lto)
+    native=$(median "$cart" native)
+    pgo=$(median "$cart" pgo)
+    echo "$cart $o3 $lto $native $pgo" | awk '{
+        printf "%-24s %10d %10d %10d %10d", $1, $2, $3, $4, $5
+        for (i = 3; i <= 5; i++) {
+            if ($2 > 0) printf " %6.2fx", $i / $2; else printf " %7s", "-"
+        }
+        printf "\n"
+    }'
+done
@@ -0,0 +1,35 @@
+#include "pipeline.h"
+
+#include <string.h>
+
+void pipeline_init(Pipeline* pipeline) {
+    memset(pipeline, 0, sizeof(Pipeline));
+    pipeline->back = 0;
+    pipeline->front = 1;
+    SDL_AtomicSet(&pipeline->middle, 2);
+}
+
+void pipeline_publish(Pipeline* pipeline, const Screen* screen) {
+    PipelineFrame* frame = &pipeline->frames[pipeline->back];
+
+    memcpy(frame->pixels, screen->pixels, SCREEN_BUFFER_SIZE);
+    memcpy(frame->colors, screen->colors, sizeof(frame->colors));
+    frame->raster = screen->raster;
+    frame->number = pipeline->published++;
+    frame->finished = SDL_GetPerformanceCounter();
+
+    // the frame must be complete before the consumer can get hold of it
+    SDL_MemoryBarrierRelease();
+    pipeline->back = SDL_AtomicSet(&pipeline->middle, pipeline->back | PIPELINE_FRESH) & ~PIPELINE_FRESH;
+}
+
+const PipelineFrame* pipeline_acquire(Pipeline* pipeline) {
+    if (!(SDL_AtomicGet(&pipeline->middle) & PIPELINE_FRESH)) {
+        return NULL;
+    }
+
+    pipeline->front = SDL_AtomicSet(&pipeline->middle, pipeline->front) & ~PIPELINE_FRESH;
+    SDL_MemoryBarrierAcquire();
+
+    return &pipeline->frames[pipeline->front];
+}
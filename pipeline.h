@@ -0,0 +1,40 @@
+#ifndef PIPELINE_H
+#define PIPELINE_H
+
+#include "SDL.h"
+
+#include "nblscreen.h"
+
+// A finished frame on its way from the Lua/raster thread to the present thread
+typedef struct PipelineFrame {
+    Uint8 pixels[SCREEN_BUFFER_SIZE];
+    Color colors[16];
+    ScreenRaster raster;
+    Uint64 finished; // performance counter when rasterization ended, for latency
+    unsigned long number;
+} PipelineFrame;
+
+// Lock-free triple buffer between one producer and one consumer.
+// The producer always has a buffer to fill and the consumer always has one to present,
+// the third one holds the newest finished frame and is swapped with either side atomically.
+// Neither side ever waits: the consumer skips frames it was too slow for and
+// shows the same frame again when the producer is too slow.
+typedef struct Pipeline {
+    PipelineFrame frames[3];
+    int back; // owned by the producer
+    int front; // owned by the consumer
+    SDL_atomic_t middle; // index of the third buffer, PIPELINE_FRESH while it holds an unseen frame
+    unsigned long published;
+} Pipeline;
+
+#define PIPELINE_FRESH 4
+
+void pipeline_init(Pipeline* pipeline);
+
+// Producer side: copies the screen into the back buffer and swaps it into the middle
+void pipeline_publish(Pipeline* pipeline, const Screen* screen);
+
+// Consumer side: returns the newest frame if one was published since the last call, NULL otherwise
+const PipelineFrame* pipeline_acquire(Pipeline* pipeline);
+
+#endif
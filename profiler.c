@@ -0,0 +1,184 @@
+#include "profiler.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+Profiler* profiler_new(unsigned int interval) {
+    Profiler* profiler = malloc(sizeof(Profiler));
+    memset(profiler, 0, sizeof(Profiler));
+
+    profiler->interval = interval > 0 ? interval : PROFILER_DEFAULT_INTERVAL;
+    profiler->capacity = 256;
+    profiler->stacks = calloc(profiler->capacity, sizeof(ProfilerStack));
+
+    return profiler;
+}
+
+static Uint64 profiler_hash(const char* frames) {
+    Uint64 hash = 0xcbf29ce484222325ULL;
+    for (; *frames; frames++) {
+        hash = (hash ^ (Uint8) *frames) * 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+static ProfilerStack* profiler_slot(ProfilerStack* stacks, size_t capacity, const char* frames) {
+    size_t i = profiler_hash(frames) & (capacity - 1);
+    while (stacks[i].frames != NULL && strcmp(stacks[i].frames, frames) != 0) {
+        i = (i + 1) & (capacity - 1);
+    }
+    return &stacks[i];
+}
+
+// Entry of a stack, added on first sight
+static ProfilerStack* profiler_find(Profiler* profiler, const char* frames) {
+    if ((profiler->count + 1) * 2 > profiler->capacity) {
+        size_t capacity = profiler->capacity * 2;
+        ProfilerStack* stacks = calloc(capacity, sizeof(ProfilerStack));
+        for (size_t i = 0; i < profiler->capacity; i++) {
+            if (profiler->stacks[i].frames != NULL) {
+                *profiler_slot(stacks, capacity, profiler->stacks[i].frames) = profiler->stacks[i];
+            }
+        }
+        free(profiler->stacks);
+        profiler->stacks = stacks;
+        profiler->capacity = capacity;
+    }
+
+    ProfilerStack* stack = profiler_slot(profiler->stacks, profiler->capacity, frames);
+    if (stack->frames == NULL) {
+        stack->frames = strdup(frames);
+        profiler->count++;
+    }
+    return stack;
+}
+
+void profiler_arm(Profiler* profiler, const char* callback) {
+    profiler->callback = callback;
+    profiler->current = NULL;
+    profiler->armed = profiler->last = SDL_GetPerformanceCounter();
+}
+
+void profiler_disarm(Profiler* profiler) {
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    // the time since the last sample goes to the same stack, or to the callback itself
+    // if it ended before the first sample
+    profiler_find(profiler, profiler->current != NULL ? profiler->current : profiler->callback)->ticks += now - profiler->last;
+
+    profiler->callback_ticks += now - profiler->armed;
+    profiler->callback = NULL;
+}
+
+// Appends text to the stack in buffer, with the separators of the format replaced
+static size_t profiler_append(char* buffer, size_t used, const char* text) {
+    for (; *text && used < PROFILER_MAX_STACK - 1; text++) {
+        buffer[used++] = *text == ';' ? ':' : *text;
+    }
+    buffer[used] = '\0';
+    return used;
+}
+
+void profiler_sample(Profiler* profiler, lua_State* L) {
+    if (profiler->callback == NULL) {
+        return;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    lua_Debug frames[PROFILER_MAX_DEPTH];
+    int depth = 0;
+
+    while (depth < PROFILER_MAX_DEPTH && lua_getstack(L, depth, &frames[depth])) {
+        lua_getinfo(L, "Sln", &frames[depth]);
+        depth++;
+    }
+
+    // root first: callback;outermost function;...;function running
+    char buffer[PROFILER_MAX_STACK];
+    size_t used = profiler_append(buffer, 0, profiler->callback);
+
+    for (int level = depth - 1; level >= 0; level--) {
+        const lua_Debug* ar = &frames[level];
+        char frame[256];
+
+        if (ar->what[0] == 'C') {
+            snprintf(frame, sizeof(frame), "%s [C]", ar->name != NULL ? ar->name : "?");
+        } else if (ar->name != NULL) {
+            snprintf(frame, sizeof(frame), "%s %s:%d", ar->name, ar->short_src, ar->currentline);
+        } else if (ar->what[0] == 'm') {
+            snprintf(frame, sizeof(frame), "main chunk %s:%d", ar->short_src, ar->currentline);
+        } else {
+            // named like luaL_traceback does, e.g. callbacks called from C
+            snprintf(frame, sizeof(frame), "function <%s:%d> %s:%d", ar->short_src, ar->linedefined, ar->short_src, ar->currentline);
+        }
+
+        if (used < PROFILER_MAX_STACK - 1) {
+            buffer[used++] = ';';
+        }
+        used = profiler_append(buffer, used, frame);
+    }
+
+    ProfilerStack* stack = profiler_find(profiler, buffer);
+    stack->ticks += start - profiler->last;
+    profiler->current = stack->frames;
+    profiler->samples++;
+
+    // the time taken here doesn't count toward any stack
+    profiler->last = SDL_GetPerformanceCounter();
+    profiler->sample_ticks += profiler->last - start;
+}
+
+void profiler_frame(Profiler* profiler, unsigned long allocs) {
+    profiler->frames++;
+    profiler->allocs += allocs;
+    if (allocs > 0) {
+        profiler->frames_allocating++;
+    }
+    if (allocs > profiler->allocs_max) {
+        profiler->allocs_max = allocs;
+    }
+}
+
+int profiler_write(Profiler* profiler, const char* filename) {
+    FILE* file = fopen(filename, "w");
+    if (file == NULL) {
+        return 0;
+    }
+
+    double us_per_tick = 1000000.0 / SDL_GetPerformanceFrequency();
+    for (size_t i = 0; i < profiler->capacity; i++) {
+        const ProfilerStack* stack = &profiler->stacks[i];
+        Uint64 us = stack->ticks * us_per_tick;
+        if (stack->frames != NULL && us > 0) {
+            fprintf(file, "%s %llu\n", stack->frames, (unsigned long long) us);
+        }
+    }
+
+    int ok = fclose(file) == 0;
+
+    double callback_ms = profiler->callback_ticks * us_per_tick / 1000;
+    double sample_ms = profiler->sample_ticks * us_per_tick / 1000;
+    printf("Profile: %lu samples of %lu stacks over %.1f ms of callbacks, %.1f ms (%.1f%%) spent sampling, written to %s\n",
+        profiler->samples, (unsigned long) profiler->count, callback_ms, sample_ms,
+        callback_ms > 0 ? sample_ms * 100 / callback_ms : 0.0, filename);
+
+    if (profiler->frames > 0) {
+        printf("Profile: %.1f Lua allocations per frame, %lu at most, %lu of %lu frames allocated\n",
+            (double) profiler->allocs / profiler->frames, profiler->allocs_max, profiler->frames_allocating, profiler->frames);
+    }
+
+    return ok;
+}
+
+void profiler_free(Profiler* profiler) {
+    if (profiler == NULL) {
+        return;
+    }
+
+    for (size_t i = 0; i < profiler->capacity; i++) {
+        free(profiler->stacks[i].frames);
+    }
+    free(profiler->stacks);
+    free(profiler);
+}
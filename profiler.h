@@ -0,0 +1,66 @@
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "SDL.h"
+
+#define PROFILER_DEFAULT_INTERVAL 10000 // Lua instructions between two samples
+#define PROFILER_MAX_DEPTH 64 // frames of a stack, deeper ones are cut at the root
+#define PROFILER_MAX_STACK 2048 // bytes of a collapsed stack
+
+typedef struct ProfilerStack {
+    char* frames; // "callback;name source:line;...", NULL for an empty slot
+    Uint64 ticks;
+} ProfilerStack;
+
+// Sampling profiler of the Lua callbacks of a cart. Every interval instructions the hook
+// records the Lua stack, weighted with the time since the previous sample, so time spent in
+// drawing primitives counts toward the line calling them.
+//
+// Writes collapsed stacks, one "frame;frame;frame weight" line per distinct stack with the
+// weight in microseconds, as read by flamegraph.pl, inferno or speedscope.
+typedef struct Profiler {
+    unsigned int interval;
+
+    ProfilerStack* stacks; // open addressing hash table
+    size_t capacity;
+    size_t count;
+
+    // callback being profiled
+    const char* callback;
+    Uint64 armed;
+    Uint64 last; // performance counter at the previous sample
+    const char* current; // frames of the previous sample, get the time left when the callback ends
+
+    unsigned long samples;
+    Uint64 callback_ticks; // time spent in profiled callbacks
+    Uint64 sample_ticks; // time spent taking samples
+
+    // Lua allocations of each frame
+    unsigned long frames;
+    unsigned long frames_allocating;
+    unsigned long allocs;
+    unsigned long allocs_max;
+} Profiler;
+
+Profiler* profiler_new(unsigned int interval);
+
+// Call before and after running a Lua callback
+void profiler_arm(Profiler* profiler, const char* callback);
+
+void profiler_disarm(Profiler* profiler);
+
+// Called from the count hook of L
+void profiler_sample(Profiler* profiler, lua_State* L);
+
+// Called once a frame with the Lua allocations it made
+void profiler_frame(Profiler* profiler, unsigned long allocs);
+
+// Writes the collapsed stacks and prints a summary. Returns 0 if the file can't be written.
+int profiler_write(Profiler* profiler, const char* filename);
+
+void profiler_free(Profiler* profiler);
+
+#endif
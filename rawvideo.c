@@ -0,0 +1,155 @@
+#include "rawvideo.h"
+
+#include <signal.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Expands one row of palette indices to scale rows of packed r, g, b
+static void rawvideo_write_rgb_row(RawVideo* video, const Uint8* indices, const Color* colors, Uint8* row) {
+    Uint8* out = row;
+
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        Color color = colors[indices[x]];
+        for (int s = 0; s < video->scale; s++) {
+            *out++ = color.r;
+            *out++ = color.g;
+            *out++ = color.b;
+        }
+    }
+
+    for (int s = 0; s < video->scale; s++) {
+        fwrite(row, 1, out - row, video->file);
+    }
+}
+
+// Expands one row of palette indices to scale rows of a single plane, lut giving the value of each index
+static void rawvideo_write_plane_row(RawVideo* video, const Uint8* indices, const Uint8* lut, Uint8* row) {
+    for (int x = 0; x < SCREEN_WIDTH; x++) {
+        memset(row + x * video->scale, lut[indices[x]], video->scale);
+    }
+
+    for (int s = 0; s < video->scale; s++) {
+        fwrite(row, 1, SCREEN_WIDTH * video->scale, video->file);
+    }
+}
+
+static void rawvideo_write_frame(RawVideo* video, const FrameSnapshot* frame, Uint8* indices, Uint8* row) {
+    framequeue_unpack(frame, indices);
+
+    if (video->format == RAWVIDEO_RGB24) {
+        for (int y = 0; y < SCREEN_HEIGHT; y++) {
+            rawvideo_write_rgb_row(video, indices + y * SCREEN_WIDTH, frame->colors, row);
+        }
+    } else {
+        Uint8 channels[3][16];
+
+        // limited range BT.601, converted once per palette entry
+        for (int i = 0; i < 16; i++) {
+            int r = frame->colors[i].r;
+            int g = frame->colors[i].g;
+            int b = frame->colors[i].b;
+            channels[0][i] = 16 + ((66 * r + 129 * g + 25 * b + 128) >> 8);
+            channels[1][i] = 128 + ((-38 * r - 74 * g + 112 * b + 128) >> 8);
+            channels[2][i] = 128 + ((112 * r - 94 * g - 18 * b + 128) >> 8);
+        }
+
+        fputs("FRAME\n", video->file);
+
+        // planar: all of Y, then U, then V
+        for (int c = 0; c < 3; c++) {
+            for (int y = 0; y < SCREEN_HEIGHT; y++) {
+                rawvideo_write_plane_row(video, indices + y * SCREEN_WIDTH, channels[c], row);
+            }
+        }
+    }
+}
+
+static int rawvideo_thread(void* data) {
+    RawVideo* video = data;
+    FrameSnapshot* frame;
+    Uint8* indices = malloc(SCREEN_WIDTH * SCREEN_HEIGHT);
+    Uint8* row = malloc(SCREEN_WIDTH * video->scale * 3);
+
+    if (video->format == RAWVIDEO_Y4M) {
+        fprintf(video->file, "YUV4MPEG2 W%d H%d F%u:1 Ip A1:1 C444\n", SCREEN_WIDTH * video->scale, SCREEN_HEIGHT * video->scale, video->fps);
+    }
+
+    while ((frame = framequeue_peek(video->queue)) != NULL) {
+        // keep draining after a failure so the main loop doesn't notice
+        if (!video->failed) {
+            rawvideo_write_frame(video, frame, indices, row);
+            if (ferror(video->file)) {
+                video->failed = 1;
+            } else {
+                video->frames++;
+            }
+        }
+        framequeue_pop(video->queue);
+    }
+
+    free(indices);
+    free(row);
+
+    return 0;
+}
+
+RawVideo* rawvideo_start(const char* filename, RawVideoFormat format, int scale, unsigned int fps, int queue_frames) {
+    FILE* file;
+
+    if (strcmp(filename, "-") == 0) {
+        // keep stdout for the frames only
+        int fd = dup(STDOUT_FILENO);
+        fflush(stdout);
+        dup2(STDERR_FILENO, STDOUT_FILENO);
+        file = fdopen(fd, "wb");
+    } else {
+        file = fopen(filename, "wb");
+    }
+
+    if (file == NULL) {
+        return NULL;
+    }
+
+    // a consumer that quits early should end the recording, not the emulator
+    signal(SIGPIPE, SIG_IGN);
+
+    RawVideo* video = malloc(sizeof(RawVideo));
+    memset(video, 0, sizeof(RawVideo));
+    video->file = file;
+    video->format = format;
+    video->scale = scale > 0 ? scale : 1;
+    video->fps = fps > 0 ? fps : 60;
+    video->queue = framequeue_new(queue_frames > 0 ? queue_frames : RAWVIDEO_DEFAULT_QUEUE_FRAMES);
+    video->thread = SDL_CreateThread(rawvideo_thread, "ves-rawvideo", video);
+
+    if (video->thread == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create raw video thread: %s", SDL_GetError());
+        framequeue_free(video->queue);
+        fclose(file);
+        free(video);
+        return NULL;
+    }
+
+    return video;
+}
+
+void rawvideo_push(RawVideo* video, const Screen* screen, unsigned int delta) {
+    framequeue_push(video->queue, screen, delta);
+}
+
+void rawvideo_stop(RawVideo* video) {
+    if (video != NULL) {
+        framequeue_close(video->queue);
+        SDL_WaitThread(video->thread, NULL);
+
+        fprintf(stderr, "Raw video: wrote %lu frames, dropped %lu\n", video->frames, video->queue->dropped);
+        if (video->failed) {
+            fprintf(stderr, "Raw video: the output was closed early\n");
+        }
+
+        fclose(video->file);
+        framequeue_free(video->queue);
+        free(video);
+    }
+}
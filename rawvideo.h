@@ -0,0 +1,42 @@
+#ifndef RAWVIDEO_H
+#define RAWVIDEO_H
+
+#include <stdio.h>
+
+#include "SDL.h"
+
+#include "framequeue.h"
+#include "nblscreen.h"
+
+#define RAWVIDEO_DEFAULT_QUEUE_FRAMES 64
+
+typedef enum RawVideoFormat {
+    RAWVIDEO_RGB24, // packed r, g, b bytes, no header
+    RAWVIDEO_Y4M // YUV4MPEG2 stream, 4:4:4 BT.601
+} RawVideoFormat;
+
+// Writes every frame to a file or pipe for an external encoder, e.g.
+//   vesemu --rawvideo - cart.lua | ffmpeg -f rawvideo -pixel_format rgb24 -video_size 128x128 -i - out.mp4
+// Frames are expanded and written on a background thread; when the consumer is too slow
+// they wait in a ring of queue_frames snapshots and are dropped once it is full.
+typedef struct RawVideo {
+    FILE* file;
+    RawVideoFormat format;
+    int scale;
+    unsigned int fps; // only used in the y4m header
+    FrameQueue* queue;
+    SDL_Thread* thread;
+    int failed; // set by the writer thread when the consumer went away
+    unsigned long frames;
+} RawVideo;
+
+// filename "-" writes to stdout, in which case the emulator's own output moves to stderr.
+// Returns NULL on failure.
+RawVideo* rawvideo_start(const char* filename, RawVideoFormat format, int scale, unsigned int fps, int queue_frames);
+
+void rawvideo_push(RawVideo* video, const Screen* screen, unsigned int delta);
+
+// Waits for the queued frames to be written and closes the output
+void rawvideo_stop(RawVideo* video);
+
+#endif
@@ -0,0 +1,132 @@
+#include "replay.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REPLAY_MAGIC "VESR"
+#define REPLAY_VERSION 1
+
+static void replay_write_varint(FILE* file, unsigned long value) {
+    while (value >= 0x80) {
+        fputc((value & 0x7F) | 0x80, file);
+        value >>= 7;
+    }
+    fputc(value, file);
+}
+
+// Returns 0 on end of file
+static int replay_read_varint(FILE* file, unsigned long* value) {
+    int c;
+    int shift = 0;
+    *value = 0;
+
+    do {
+        if ((c = fgetc(file)) == EOF || shift > 63) {
+            return 0;
+        }
+        *value |= (unsigned long) (c & 0x7F) << shift;
+        shift += 7;
+    } while (c & 0x80);
+
+    return 1;
+}
+
+static void replay_flush_run(Replay* replay) {
+    if (replay->run_count == 0) {
+        return;
+    }
+
+    replay_write_varint(replay->file, replay->run_count);
+    replay_write_varint(replay->file, replay->run_delta);
+    fputc(replay->run_buttons, replay->file);
+    replay->run_count = 0;
+}
+
+Replay* replay_record(const char* filename, Uint64 seed) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    Replay* replay = malloc(sizeof(Replay));
+    memset(replay, 0, sizeof(Replay));
+    replay->file = file;
+    replay->recording = 1;
+    replay->seed = seed;
+
+    fwrite(REPLAY_MAGIC, 1, 4, file);
+    fputc(REPLAY_VERSION, file);
+    for (int i = 0; i < 8; i++) {
+        fputc((seed >> (i * 8)) & 0xFF, file);
+    }
+
+    return replay;
+}
+
+Replay* replay_play(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    Uint8 header[13];
+    if (fread(header, 1, sizeof(header), file) != sizeof(header) || memcmp(header, REPLAY_MAGIC, 4) || header[4] != REPLAY_VERSION) {
+        fclose(file);
+        return NULL;
+    }
+
+    Replay* replay = malloc(sizeof(Replay));
+    memset(replay, 0, sizeof(Replay));
+    replay->file = file;
+
+    for (int i = 0; i < 8; i++) {
+        replay->seed |= (Uint64) header[5 + i] << (i * 8);
+    }
+
+    return replay;
+}
+
+void replay_write_frame(Replay* replay, unsigned int delta, Uint8 buttons) {
+    if (replay->run_count > 0 && (delta != replay->run_delta || buttons != replay->run_buttons)) {
+        replay_flush_run(replay);
+    }
+
+    replay->run_delta = delta;
+    replay->run_buttons = buttons;
+    replay->run_count++;
+    replay->frames++;
+}
+
+int replay_read_frame(Replay* replay, unsigned int* delta, Uint8* buttons) {
+    // read the next run, skipping empty ones
+    while (replay->run_count == 0) {
+        unsigned long count;
+        unsigned long run_delta;
+        int run_buttons;
+
+        if (!replay_read_varint(replay->file, &count) || !replay_read_varint(replay->file, &run_delta) || (run_buttons = fgetc(replay->file)) == EOF) {
+            return 0;
+        }
+
+        replay->run_count = count;
+        replay->run_delta = run_delta;
+        replay->run_buttons = run_buttons;
+    }
+
+    *delta = replay->run_delta;
+    *buttons = replay->run_buttons;
+    replay->run_count--;
+    replay->frames++;
+
+    return 1;
+}
+
+void replay_close(Replay* replay) {
+    if (replay != NULL) {
+        if (replay->recording) {
+            replay_flush_run(replay);
+        }
+        fclose(replay->file);
+        free(replay);
+    }
+}
@@ -0,0 +1,41 @@
+#ifndef REPLAY_H
+#define REPLAY_H
+
+#include <stdio.h>
+
+#include "SDL.h"
+
+// Record and replay of the per-frame inputs of a cart: the delta passed to _screen_draw and
+// the buttons held. Together with the random seed stored in the header this makes a run
+// reproducible.
+//
+// File format, all integers little endian:
+//   "VESR", version (u8), seed (u64)
+//   then runs of identical frames: count (varint), delta (varint), buttons (u8)
+typedef struct Replay {
+    FILE* file;
+    int recording;
+    Uint64 seed;
+
+    // run being recorded or played back
+    unsigned long run_count;
+    unsigned int run_delta;
+    Uint8 run_buttons;
+
+    unsigned long frames;
+} Replay;
+
+// Both return NULL on failure
+Replay* replay_record(const char* filename, Uint64 seed);
+
+Replay* replay_play(const char* filename);
+
+void replay_write_frame(Replay* replay, unsigned int delta, Uint8 buttons);
+
+// Returns 0 once the log is exhausted
+int replay_read_frame(Replay* replay, unsigned int* delta, Uint8* buttons);
+
+// Flushes the last run of a recording
+void replay_close(Replay* replay);
+
+#endif
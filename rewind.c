@@ -0,0 +1,204 @@
+#include "rewind.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framecodec.h"
+#include "savestate.h"
+
+Rewind* rewind_new(size_t budget, int keyframe) {
+    Rewind* rewind = malloc(sizeof(Rewind));
+    if (rewind == NULL) {
+        return NULL;
+    }
+    memset(rewind, 0, sizeof(Rewind));
+
+    if ((rewind->data = malloc(budget)) == NULL) {
+        free(rewind);
+        return NULL;
+    }
+    rewind->budget = budget;
+    rewind->keyframe = keyframe > 0 ? keyframe : REWIND_DEFAULT_KEYFRAME;
+
+    return rewind;
+}
+
+// Grows the state buffers, keeping them zero past what they hold.
+// Returns 0 if memory runs out, the buffers that did grow are kept.
+static int rewind_reserve(Rewind* rewind, size_t size) {
+    if (size <= rewind->capacity) {
+        return 1;
+    }
+
+    size_t capacity = rewind->capacity > 0 ? rewind->capacity : 4096;
+    while (capacity < size) {
+        capacity *= 2;
+    }
+
+    Uint8** buffers[] = {&rewind->current, &rewind->next, &rewind->zeros};
+    for (int i = 0; i < 3; i++) {
+        Uint8* buffer = realloc(*buffers[i], capacity);
+        if (buffer == NULL) {
+            return 0;
+        }
+        memset(buffer + rewind->capacity, 0, capacity - rewind->capacity);
+        *buffers[i] = buffer;
+    }
+    Uint8* coded = realloc(rewind->coded, FRAMECODEC_MAX_SIZE(capacity));
+    if (coded == NULL) {
+        return 0;
+    }
+    rewind->coded = coded;
+    rewind->capacity = capacity;
+    return 1;
+}
+
+static void rewind_drop_oldest(Rewind* rewind) {
+    rewind->first = (rewind->first + 1) % REWIND_MAX_FRAMES;
+    rewind->count--;
+    rewind->dropped++;
+}
+
+// Room for size bytes at the write position, wrapping around and dropping the oldest
+// entries in the way. Returns 0 if size doesn't fit the budget at all.
+static int rewind_make_room(Rewind* rewind, size_t size) {
+    if (size > rewind->budget) {
+        return 0;
+    }
+
+    if (rewind->write + size > rewind->budget) {
+        // the end of the ring stays unused until the entries before it are dropped
+        while (rewind->count > 0 && rewind->entries[rewind->first].offset >= rewind->write) {
+            rewind_drop_oldest(rewind);
+        }
+        rewind->write = 0;
+    }
+
+    while (rewind->count > 0) {
+        const RewindEntry* oldest = &rewind->entries[rewind->first];
+        if (oldest->offset >= rewind->write + size || oldest->offset + oldest->size <= rewind->write) {
+            break;
+        }
+        rewind_drop_oldest(rewind);
+    }
+
+    if (rewind->count == REWIND_MAX_FRAMES) {
+        rewind_drop_oldest(rewind);
+    }
+
+    return 1;
+}
+
+int rewind_push(Rewind* rewind, Cart* cart) {
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    SaveState* state = savestate_save(cart, SAVESTATE_RAW);
+    if (state == NULL) {
+        return 0;
+    }
+
+    if (!rewind_reserve(rewind, state->size)) {
+        printf("! Rewind: out of memory for a %lu bytes state\n", (unsigned long) state->size);
+        savestate_free(state);
+        return 0;
+    }
+    memcpy(rewind->next, state->data, state->size);
+    memset(rewind->next + state->size, 0, rewind->capacity - state->size);
+
+    if (rewind->frame > 0) {
+        // the current frame becomes an entry coded against the next one, or a keyframe
+        int keyframe = (rewind->frame - 1) % rewind->keyframe == 0;
+        size_t size = rewind->current_size > state->size ? rewind->current_size : state->size;
+        size_t coded_size = keyframe
+            ? framecodec_encode(rewind->current, rewind->zeros, rewind->current_size, rewind->coded)
+            : framecodec_encode(rewind->current, rewind->next, size, rewind->coded);
+
+        if (rewind_make_room(rewind, coded_size)) {
+            RewindEntry* entry = &rewind->entries[(rewind->first + rewind->count) % REWIND_MAX_FRAMES];
+            entry->offset = rewind->write;
+            entry->size = coded_size;
+            entry->state_size = rewind->current_size;
+            entry->keyframe = keyframe;
+            memcpy(rewind->data + rewind->write, rewind->coded, coded_size);
+            rewind->write += coded_size;
+            rewind->count++;
+        } else {
+            // a single frame larger than the budget, the history before it is useless now
+            rewind->dropped += rewind->count;
+            rewind->count = 0;
+        }
+    }
+
+    Uint8* current = rewind->current;
+    rewind->current = rewind->next;
+    rewind->next = current;
+    rewind->current_size = state->size;
+    rewind->frame++;
+    savestate_free(state);
+
+    rewind->pushed++;
+    rewind->push_ticks += SDL_GetPerformanceCounter() - start;
+    return 1;
+}
+
+int rewind_step_back(Rewind* rewind, Cart* cart) {
+    if (rewind->count == 0) {
+        return 0;
+    }
+
+    rewind->count--;
+    const RewindEntry* entry = &rewind->entries[(rewind->first + rewind->count) % REWIND_MAX_FRAMES];
+    const Uint8* coded = rewind->data + entry->offset;
+    int decoded;
+
+    if (entry->keyframe) {
+        memset(rewind->current, 0, rewind->current_size);
+        decoded = framecodec_decode(coded, entry->size, rewind->current, entry->state_size);
+    } else {
+        size_t size = rewind->current_size > entry->state_size ? rewind->current_size : entry->state_size;
+        decoded = framecodec_decode(coded, entry->size, rewind->current, size);
+    }
+    if (!decoded) {
+        printf("! Rewind: broken history, dropped\n");
+        rewind->dropped += rewind->count;
+        rewind->count = 0;
+        return -1;
+    }
+    rewind->current_size = entry->state_size;
+    rewind->write = entry->offset;
+    rewind->frame--;
+
+    return savestate_load(cart, rewind->current, rewind->current_size) ? 1 : -1;
+}
+
+void rewind_clear(Rewind* rewind) {
+    rewind->dropped += rewind->count;
+    rewind->count = 0;
+    rewind->write = 0;
+    rewind->frame = 0;
+}
+
+void rewind_free(Rewind* rewind) {
+    if (rewind == NULL) {
+        return;
+    }
+
+    size_t used = 0;
+    for (int i = 0; i < rewind->count; i++) {
+        used += rewind->entries[(rewind->first + i) % REWIND_MAX_FRAMES].size;
+    }
+
+    if (rewind->pushed > 0) {
+        printf("Rewind: %d frames held in %lu of %lu KB, %lu dropped, %.3f ms per snapshot\n",
+            rewind->count, (unsigned long) used / 1024, (unsigned long) rewind->budget / 1024, rewind->dropped,
+            (double) rewind->push_ticks * 1000 / SDL_GetPerformanceFrequency() / rewind->pushed);
+    }
+
+    free(rewind->data);
+    free(rewind->current);
+    free(rewind->next);
+    free(rewind->zeros);
+    free(rewind->coded);
+    free(rewind);
+}
@@ -0,0 +1,69 @@
+#ifndef REWIND_H
+#define REWIND_H
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+#include "cart.h"
+
+#define REWIND_DEFAULT_KEYFRAME 60 // frames between keyframes
+#define REWIND_MAX_FRAMES 36000 // ten minutes at 60 frames per second
+
+// One frame of history, turning the state of the frame after it into its own
+typedef struct RewindEntry {
+    size_t offset; // in Rewind.data
+    size_t size; // encoded
+    size_t state_size;
+    int keyframe; // coded against zeros instead of the next frame
+} RewindEntry;
+
+// Hold-to-rewind history of a cart. The current state is kept in full, older frames as
+// backward deltas: the XOR of their savestate (SAVESTATE_RAW, so the framebuffer and RAM
+// line up) against the one of the frame after, run-length coded with framecodec. Every
+// keyframe frames an entry is coded against zeros instead, which bounds how far a broken
+// delta could spread. Stepping back one frame decodes one entry, whatever the length of
+// the history.
+//
+// Entries live in a ring of budget bytes, the oldest ones are dropped to make room.
+typedef struct Rewind {
+    Uint8* data;
+    size_t budget;
+    size_t write; // where the next entry goes
+    RewindEntry entries[REWIND_MAX_FRAMES];
+    int first; // oldest entry
+    int count;
+    int keyframe;
+    unsigned long frame; // frames pushed and not stepped back, the current one included
+
+    // current and next state, zero past their sizes so states of different sizes diff cleanly
+    Uint8* current;
+    size_t current_size;
+    Uint8* next;
+    Uint8* zeros;
+    Uint8* coded;
+    size_t capacity; // of the four buffers above
+
+    unsigned long pushed;
+    unsigned long dropped;
+    Uint64 push_ticks;
+} Rewind;
+
+// Returns NULL if budget can't be allocated
+Rewind* rewind_new(size_t budget, int keyframe);
+
+// Snapshots the cart after a frame ran. Returns 0 if the cart holds something that can't be saved
+// or memory runs out.
+int rewind_push(Rewind* rewind, Cart* cart);
+
+// Brings the cart back by one frame. Returns 0 with nothing left to rewind, -1 if the history
+// is broken or the state didn't load, which leaves the cart as it was.
+int rewind_step_back(Rewind* rewind, Cart* cart);
+
+// Forgets the history, e.g. once the cart it was taken from is gone
+void rewind_clear(Rewind* rewind);
+
+// Prints the usage of the history
+void rewind_free(Rewind* rewind);
+
+#endif
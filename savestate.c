@@ -0,0 +1,719 @@
+#include "savestate.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framecodec.h"
+
+#define SAVESTATE_MAGIC "VESS"
+#define SAVESTATE_VERSION 4
+#define SAVESTATE_PERM_DEPTH 3 // how deep under _G C functions and userdata get names
+
+typedef enum SaveTag {
+    SAVE_NIL,
+    SAVE_FALSE,
+    SAVE_TRUE,
+    SAVE_INTEGER, // zigzag varint
+    SAVE_FLOAT, // 8 bytes, host order
+    SAVE_STRING, // varint length, bytes
+    SAVE_TABLE, // varint array and hash sizes, key, value pairs, SAVE_END, metatable
+    SAVE_FUNCTION, // varint prototype (0: a new one follows as varint length, lua_dump chunk), upvalues
+    SAVE_PERM, // varint length, name
+    SAVE_REF, // varint number of a table, closure or string seen before
+    SAVE_END,
+    SAVE_UPVALUE_NEW, // value follows
+    SAVE_UPVALUE_JOIN // varint closure, varint upvalue: shares that upvalue
+} SaveTag;
+
+// Everything outside the Lua heap, delta coded as one block
+typedef struct SaveBlock {
+    Uint8 pixels[SCREEN_BUFFER_SIZE];
+    Color colors[16];
+    ScreenRaster raster;
+    Uint8 draw_palette[16];
+    Uint16 transparent;
+    int camera[2];
+    int clip[4];
+    Uint8 ram[MEMORY_RAM_SIZE];
+    Input input;
+    Uint64 update_time;
+} SaveBlock;
+
+typedef struct SaveWriter {
+    SaveState* state;
+    int seen; // stack indices of tables: object -> number
+    int perms; // value -> name
+    int protos; // lua_dump chunk -> number
+    int upvalues; // upvalue id -> closure number * 256 + upvalue
+    lua_Integer objects;
+    lua_Integer proto_count;
+    int depth;
+} SaveWriter;
+
+typedef struct SaveReader {
+    const Uint8* data;
+    size_t size;
+    size_t pos;
+    int objects; // stack indices of tables: number -> object
+    int perms; // name -> value
+    int protos; // number -> lua_dump chunk
+    lua_Integer object_count;
+    lua_Integer proto_count;
+    int depth;
+} SaveReader;
+
+static void save_bytes(SaveState* state, const void* bytes, size_t size) {
+    if (state->size + size > state->capacity) {
+        while (state->size + size > state->capacity) {
+            state->capacity = state->capacity > 0 ? state->capacity * 2 : 4096;
+        }
+        state->data = realloc(state->data, state->capacity);
+    }
+
+    memcpy(state->data + state->size, bytes, size);
+    state->size += size;
+}
+
+static void save_u8(SaveState* state, Uint8 value) {
+    save_bytes(state, &value, 1);
+}
+
+static void save_varint(SaveState* state, Uint64 value) {
+    while (value >= 0x80) {
+        save_u8(state, (value & 0x7F) | 0x80);
+        value >>= 7;
+    }
+    save_u8(state, value);
+}
+
+static int save_dump_writer(lua_State* L, const void* p, size_t size, void* data) {
+    save_bytes(data, p, size);
+    return 0;
+}
+
+// Names every C function and userdata reachable through tables under _G, e.g. "math.floor"
+// or "package.searchers.1". The load side maps every name to its value, the save side maps
+// each value to its shortest name, so the names don't depend on the order of lua_next.
+// Only tables under string keys are walked: arrays of tables are cart data, not libraries.
+static void save_name_perms(lua_State* L, int table, int perms, const char* prefix, int depth, int by_name) {
+    lua_pushnil(L);
+    while (lua_next(L, table)) {
+        // most values of a cart are plain data, skipped before a name is built for them
+        int type = lua_type(L, -1);
+        int perm = type == LUA_TUSERDATA || type == LUA_TLIGHTUSERDATA || (type == LUA_TFUNCTION && lua_iscfunction(L, -1));
+        if (!perm && !(type == LUA_TTABLE && depth > 1 && lua_type(L, -2) == LUA_TSTRING)) {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        char name[256];
+        int key_type = lua_type(L, -2);
+
+        if (key_type == LUA_TSTRING) {
+            snprintf(name, sizeof(name), "%s%s", prefix, lua_tostring(L, -2));
+        } else if (key_type == LUA_TNUMBER && lua_isinteger(L, -2)) {
+            snprintf(name, sizeof(name), "%s%lld", prefix, (long long) lua_tointeger(L, -2));
+        } else {
+            lua_pop(L, 1);
+            continue;
+        }
+
+        if (perm) {
+            if (by_name) {
+                lua_pushstring(L, name);
+                lua_pushvalue(L, -2);
+                lua_rawset(L, perms);
+            } else {
+                lua_pushvalue(L, -1);
+                lua_rawget(L, perms);
+                size_t size = strlen(name);
+                size_t known_size;
+                const char* known = lua_tolstring(L, -1, &known_size);
+                int shorter = known == NULL || size < known_size || (size == known_size && strcmp(name, known) < 0);
+                lua_pop(L, 1);
+
+                if (shorter) {
+                    lua_pushvalue(L, -1);
+                    lua_pushstring(L, name);
+                    lua_rawset(L, perms);
+                }
+            }
+        } else {
+            // the depth bounds the walk, cycles like package.loaded._G included
+            size_t size = strlen(name);
+            if (size + 1 < sizeof(name)) {
+                name[size] = '.';
+                name[size + 1] = '\0';
+                save_name_perms(L, lua_gettop(L), perms, name, depth - 1, by_name);
+            }
+        }
+
+        lua_pop(L, 1);
+    }
+}
+
+// Pushes the table of perms of the state
+static void save_push_perms(lua_State* L, int by_name) {
+    lua_newtable(L);
+    int perms = lua_gettop(L);
+
+    lua_pushglobaltable(L);
+    save_name_perms(L, lua_gettop(L), perms, "", SAVESTATE_PERM_DEPTH, by_name);
+    lua_pop(L, 1);
+}
+
+static void save_value(lua_State* L, SaveWriter* w, int index);
+
+static void save_function(lua_State* L, SaveWriter* w, int index, lua_Integer number) {
+    if (lua_iscfunction(L, index)) {
+        luaL_error(L, "can't save a C function that isn't reachable from _G");
+    }
+
+    // one chunk per prototype, closures of the same function refer to it
+    SaveState dump;
+    memset(&dump, 0, sizeof(SaveState));
+    lua_pushvalue(L, index);
+    lua_dump(L, save_dump_writer, &dump, 0);
+    lua_pop(L, 1);
+
+    save_u8(w->state, SAVE_FUNCTION);
+    lua_pushlstring(L, (const char*) dump.data, dump.size);
+    free(dump.data);
+    lua_pushvalue(L, -1);
+    if (lua_rawget(L, w->protos) == LUA_TNUMBER) {
+        save_varint(w->state, lua_tointeger(L, -1));
+        lua_pop(L, 2);
+    } else {
+        lua_pop(L, 1);
+        size_t size;
+        const char* chunk = lua_tolstring(L, -1, &size);
+        save_varint(w->state, 0);
+        save_varint(w->state, size);
+        save_bytes(w->state, chunk, size);
+        lua_pushinteger(L, ++w->proto_count);
+        lua_rawset(L, w->protos);
+    }
+
+    lua_Debug ar;
+    lua_pushvalue(L, index);
+    lua_getinfo(L, ">u", &ar);
+
+    for (int n = 1; n <= ar.nups; n++) {
+        void* id = lua_upvalueid(L, index, n);
+
+        lua_pushlightuserdata(L, id);
+        if (lua_rawget(L, w->upvalues) == LUA_TNUMBER) {
+            lua_Integer shared = lua_tointeger(L, -1);
+            lua_pop(L, 1);
+            save_u8(w->state, SAVE_UPVALUE_JOIN);
+            save_varint(w->state, shared / 256);
+            save_varint(w->state, shared % 256);
+            continue;
+        }
+        lua_pop(L, 1);
+
+        // known before its value is saved, in case the value leads back to this upvalue
+        lua_pushlightuserdata(L, id);
+        lua_pushinteger(L, number * 256 + n);
+        lua_rawset(L, w->upvalues);
+
+        save_u8(w->state, SAVE_UPVALUE_NEW);
+        lua_getupvalue(L, index, n);
+        save_value(L, w, lua_gettop(L));
+        lua_pop(L, 1);
+    }
+}
+
+static void save_value(lua_State* L, SaveWriter* w, int index) {
+    int type = lua_type(L, index);
+
+    luaL_checkstack(L, 8, "state nested too deeply");
+    if (++w->depth > SAVESTATE_MAX_DEPTH) {
+        luaL_error(L, "state nested deeper than %d", SAVESTATE_MAX_DEPTH);
+    }
+
+    switch (type) {
+        case LUA_TNIL:
+            save_u8(w->state, SAVE_NIL);
+            break;
+        case LUA_TBOOLEAN:
+            save_u8(w->state, lua_toboolean(L, index) ? SAVE_TRUE : SAVE_FALSE);
+            break;
+        case LUA_TNUMBER:
+            if (lua_isinteger(L, index)) {
+                Uint64 value = lua_tointeger(L, index);
+                save_u8(w->state, SAVE_INTEGER);
+                save_varint(w->state, (value << 1) ^ (Uint64) -(Sint64) (value >> 63));
+            } else {
+                double value = lua_tonumber(L, index);
+                save_u8(w->state, SAVE_FLOAT);
+                save_bytes(w->state, &value, sizeof(double));
+            }
+            break;
+        case LUA_TTHREAD:
+            luaL_error(L, "can't save a coroutine");
+            break;
+        default: {
+            if (type != LUA_TSTRING && type != LUA_TTABLE) {
+                lua_pushvalue(L, index);
+                if (lua_rawget(L, w->perms) == LUA_TSTRING) {
+                    size_t size;
+                    const char* name = lua_tolstring(L, -1, &size);
+                    save_u8(w->state, SAVE_PERM);
+                    save_varint(w->state, size);
+                    save_bytes(w->state, name, size);
+                    lua_pop(L, 1);
+                    break;
+                }
+                lua_pop(L, 1);
+            }
+
+            lua_pushvalue(L, index);
+            if (lua_rawget(L, w->seen) == LUA_TNUMBER) {
+                save_u8(w->state, SAVE_REF);
+                save_varint(w->state, lua_tointeger(L, -1));
+                lua_pop(L, 1);
+                break;
+            }
+            lua_pop(L, 1);
+
+            lua_Integer number = ++w->objects;
+            lua_pushvalue(L, index);
+            lua_pushinteger(L, number);
+            lua_rawset(L, w->seen);
+
+            if (type == LUA_TSTRING) {
+                size_t size;
+                const char* string = lua_tolstring(L, index, &size);
+                save_u8(w->state, SAVE_STRING);
+                save_varint(w->state, size);
+                save_bytes(w->state, string, size);
+            } else if (type == LUA_TTABLE) {
+                // sizes first so the load side creates the table at its size instead of growing it
+                lua_Unsigned length = lua_rawlen(L, index);
+                lua_Unsigned pairs = 0;
+                lua_pushnil(L);
+                while (lua_next(L, index)) {
+                    lua_pop(L, 1);
+                    pairs++;
+                }
+                save_u8(w->state, SAVE_TABLE);
+                save_varint(w->state, length);
+                save_varint(w->state, pairs > length ? pairs - length : 0);
+
+                lua_pushnil(L);
+                while (lua_next(L, index)) {
+                    int top = lua_gettop(L);
+                    save_value(L, w, top - 1);
+                    save_value(L, w, top);
+                    lua_pop(L, 1);
+                }
+                save_u8(w->state, SAVE_END);
+
+                if (lua_getmetatable(L, index)) {
+                    save_value(L, w, lua_gettop(L));
+                    lua_pop(L, 1);
+                } else {
+                    save_u8(w->state, SAVE_NIL);
+                }
+            } else if (type == LUA_TFUNCTION) {
+                save_function(L, w, index, number);
+            } else {
+                luaL_error(L, "can't save a %s that isn't reachable from _G", lua_typename(L, type));
+            }
+        }
+    }
+
+    w->depth--;
+}
+
+static int savestate_save_protected(lua_State* L) {
+    SaveWriter* w = lua_touserdata(L, 1);
+
+    lua_newtable(L);
+    w->seen = lua_gettop(L);
+    save_push_perms(L, 0);
+    w->perms = lua_gettop(L);
+    lua_newtable(L);
+    w->protos = lua_gettop(L);
+    lua_newtable(L);
+    w->upvalues = lua_gettop(L);
+
+    // the global table comes first, as object number 1
+    lua_pushglobaltable(L);
+    save_value(L, w, lua_gettop(L));
+
+    return 0;
+}
+
+static void savestate_block(Cart* cart, SaveBlock* block) {
+    memset(block, 0, sizeof(SaveBlock));
+    memcpy(block->pixels, cart->screen->pixels, SCREEN_BUFFER_SIZE);
+    memcpy(block->colors, cart->screen->colors, sizeof(block->colors));
+    block->raster = cart->screen->raster;
+    memcpy(block->draw_palette, cart->screen->draw_palette, sizeof(block->draw_palette));
+    block->transparent = cart->screen->transparent;
+    block->camera[0] = cart->screen->camera_x;
+    block->camera[1] = cart->screen->camera_y;
+    block->clip[0] = cart->screen->clip_x1;
+    block->clip[1] = cart->screen->clip_y1;
+    block->clip[2] = cart->screen->clip_x2;
+    block->clip[3] = cart->screen->clip_y2;
+    memcpy(block->ram, cart->memory.ram, MEMORY_RAM_SIZE);
+    block->input = cart->input;
+    block->update_time = cart->update_time;
+}
+
+SaveState* savestate_save(Cart* cart, int flags) {
+    lua_State* L = cart->L;
+    SaveState* state = malloc(sizeof(SaveState));
+    memset(state, 0, sizeof(SaveState));
+
+    save_bytes(state, SAVESTATE_MAGIC, 4);
+    save_u8(state, SAVESTATE_VERSION);
+    save_u8(state, flags);
+
+    SaveBlock* block = malloc(sizeof(SaveBlock));
+    savestate_block(cart, block);
+    if (flags & SAVESTATE_RAW) {
+        save_bytes(state, block, sizeof(SaveBlock));
+    } else {
+        // mostly zeros, as cheap to code against zeros as it gets
+        Uint8* zeros = calloc(1, sizeof(SaveBlock));
+        Uint8* coded = malloc(FRAMECODEC_MAX_SIZE(sizeof(SaveBlock)));
+        size_t coded_size = framecodec_encode((const Uint8*) block, zeros, sizeof(SaveBlock), coded);
+        save_varint(state, coded_size);
+        save_bytes(state, coded, coded_size);
+        free(coded);
+        free(zeros);
+    }
+    free(block);
+
+    SaveWriter writer;
+    memset(&writer, 0, sizeof(SaveWriter));
+    writer.state = state;
+
+    int top = lua_gettop(L);
+    lua_pushcfunction(L, savestate_save_protected);
+    lua_pushlightuserdata(L, &writer);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        printf("! State: couldn't save, %s\n", lua_tostring(L, -1));
+        lua_settop(L, top);
+        savestate_free(state);
+        return NULL;
+    }
+    lua_settop(L, top);
+
+    return state;
+}
+
+static Uint8 load_u8(lua_State* L, SaveReader* r) {
+    if (r->pos >= r->size) {
+        luaL_error(L, "state ends early");
+    }
+    return r->data[r->pos++];
+}
+
+static Uint64 load_varint(lua_State* L, SaveReader* r) {
+    Uint64 value = 0;
+    int shift = 0;
+    Uint8 byte;
+
+    do {
+        if (shift > 63) {
+            luaL_error(L, "bad number in state");
+        }
+        byte = load_u8(L, r);
+        value |= (Uint64) (byte & 0x7F) << shift;
+        shift += 7;
+    } while (byte & 0x80);
+
+    return value;
+}
+
+static const char* load_bytes(lua_State* L, SaveReader* r, size_t size) {
+    if (size > r->size - r->pos) {
+        luaL_error(L, "state ends early");
+    }
+    const char* bytes = (const char*) r->data + r->pos;
+    r->pos += size;
+    return bytes;
+}
+
+static void load_value(lua_State* L, SaveReader* r);
+
+static void load_function(lua_State* L, SaveReader* r) {
+    lua_Integer proto = load_varint(L, r);
+
+    if (proto == 0) {
+        size_t size = load_varint(L, r);
+        const char* chunk = load_bytes(L, r, size);
+        lua_pushlstring(L, chunk, size);
+        lua_rawseti(L, r->protos, ++r->proto_count);
+        proto = r->proto_count;
+    }
+
+    if (lua_rawgeti(L, r->protos, proto) != LUA_TSTRING) {
+        luaL_error(L, "bad function in state");
+    }
+    size_t size;
+    const char* chunk = lua_tolstring(L, -1, &size);
+    if (luaL_loadbufferx(L, chunk, size, "=state", "b") != LUA_OK) {
+        lua_error(L);
+    }
+    lua_remove(L, -2);
+
+    int function = lua_gettop(L);
+    lua_pushvalue(L, function);
+    lua_rawseti(L, r->objects, ++r->object_count);
+
+    lua_Debug ar;
+    lua_pushvalue(L, function);
+    lua_getinfo(L, ">u", &ar);
+
+    for (int n = 1; n <= ar.nups; n++) {
+        Uint8 tag = load_u8(L, r);
+
+        if (tag == SAVE_UPVALUE_NEW) {
+            load_value(L, r);
+            lua_setupvalue(L, function, n);
+        } else if (tag == SAVE_UPVALUE_JOIN) {
+            lua_Integer closure = load_varint(L, r);
+            int upvalue = load_varint(L, r);
+            if (lua_rawgeti(L, r->objects, closure) != LUA_TFUNCTION || lua_upvalueid(L, -1, upvalue) == NULL) {
+                luaL_error(L, "bad upvalue in state");
+            }
+            lua_upvaluejoin(L, function, n, -1, upvalue);
+            lua_pop(L, 1);
+        } else {
+            luaL_error(L, "bad upvalue in state");
+        }
+    }
+}
+
+static void load_value(lua_State* L, SaveReader* r) {
+    luaL_checkstack(L, 8, "state nested too deeply");
+    if (++r->depth > SAVESTATE_MAX_DEPTH) {
+        luaL_error(L, "state nested deeper than %d", SAVESTATE_MAX_DEPTH);
+    }
+
+    Uint8 tag = load_u8(L, r);
+
+    switch (tag) {
+        case SAVE_NIL:
+            lua_pushnil(L);
+            break;
+        case SAVE_FALSE:
+        case SAVE_TRUE:
+            lua_pushboolean(L, tag == SAVE_TRUE);
+            break;
+        case SAVE_INTEGER: {
+            Uint64 value = load_varint(L, r);
+            lua_pushinteger(L, (lua_Integer) ((value >> 1) ^ -(value & 1)));
+            break;
+        }
+        case SAVE_FLOAT: {
+            double value;
+            memcpy(&value, load_bytes(L, r, sizeof(double)), sizeof(double));
+            lua_pushnumber(L, value);
+            break;
+        }
+        case SAVE_STRING: {
+            size_t size = load_varint(L, r);
+            lua_pushlstring(L, load_bytes(L, r, size), size);
+            lua_pushvalue(L, -1);
+            lua_rawseti(L, r->objects, ++r->object_count);
+            break;
+        }
+        case SAVE_TABLE: {
+            // every pair takes at least two bytes, so bigger sizes can't be right
+            Uint64 length = load_varint(L, r);
+            Uint64 hash = load_varint(L, r);
+            Uint64 limit = (r->size - r->pos) / 2;
+            lua_createtable(L, length < limit ? length : limit, hash < limit ? hash : limit);
+            int table = lua_gettop(L);
+            lua_pushvalue(L, table);
+            lua_rawseti(L, r->objects, ++r->object_count);
+
+            while (r->pos < r->size && r->data[r->pos] != SAVE_END) {
+                load_value(L, r);
+                load_value(L, r);
+                if (lua_isnil(L, -2)) {
+                    luaL_error(L, "bad table key in state");
+                }
+                lua_rawset(L, table);
+            }
+            load_u8(L, r);
+
+            load_value(L, r);
+            if (lua_istable(L, -1)) {
+                lua_setmetatable(L, table);
+            } else {
+                lua_pop(L, 1);
+            }
+            break;
+        }
+        case SAVE_FUNCTION:
+            load_function(L, r);
+            break;
+        case SAVE_PERM: {
+            size_t size = load_varint(L, r);
+            lua_pushlstring(L, load_bytes(L, r, size), size);
+            lua_pushvalue(L, -1);
+            if (lua_rawget(L, r->perms) == LUA_TNIL) {
+                luaL_error(L, "state refers to %s, which this cart doesn't have", lua_tostring(L, -2));
+            }
+            lua_remove(L, -2);
+            break;
+        }
+        case SAVE_REF:
+            if (lua_rawgeti(L, r->objects, load_varint(L, r)) == LUA_TNIL) {
+                luaL_error(L, "bad reference in state");
+            }
+            break;
+        default:
+            luaL_error(L, "bad value in state");
+    }
+
+    r->depth--;
+}
+
+static int savestate_load_protected(lua_State* L) {
+    SaveReader* r = lua_touserdata(L, 1);
+
+    lua_newtable(L);
+    r->objects = lua_gettop(L);
+    save_push_perms(L, 1);
+    r->perms = lua_gettop(L);
+    lua_newtable(L);
+    r->protos = lua_gettop(L);
+
+    // the globals go into a fresh table, the running ones stay as they are until all of it loaded
+    if (r->pos >= r->size || r->data[r->pos] != SAVE_TABLE) {
+        luaL_error(L, "bad global table in state");
+    }
+    load_value(L, r);
+    int globals = lua_gettop(L);
+
+    // nothing can fail from here on: the new table becomes _G, closures of the state refer to it already
+    lua_pushvalue(L, globals);
+    lua_rawseti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+    if (lua_getfield(L, LUA_REGISTRYINDEX, LUA_LOADED_TABLE) == LUA_TTABLE) {
+        lua_pushvalue(L, globals);
+        lua_setfield(L, -2, LUA_GNAME);
+    }
+
+    return 0;
+}
+
+int savestate_load(Cart* cart, const Uint8* data, size_t size) {
+    lua_State* L = cart->L;
+
+    if (size < 6 || memcmp(data, SAVESTATE_MAGIC, 4) != 0 || data[4] != SAVESTATE_VERSION) {
+        printf("! State: not a state of this version\n");
+        return 0;
+    }
+
+    SaveReader reader;
+    memset(&reader, 0, sizeof(SaveReader));
+    reader.data = data;
+    reader.size = size;
+    reader.pos = 6;
+    int flags = data[5];
+
+    // the block and the Lua tree are both decoded before anything of the cart changes
+    Uint64 coded_size = sizeof(SaveBlock);
+    if (!(flags & SAVESTATE_RAW)) {
+        coded_size = 0;
+        int shift = 0;
+        Uint8 byte;
+        do {
+            if (reader.pos >= size || shift > 63) {
+                printf("! State: truncated\n");
+                return 0;
+            }
+            byte = data[reader.pos++];
+            coded_size |= (Uint64) (byte & 0x7F) << shift;
+            shift += 7;
+        } while (byte & 0x80);
+    }
+
+    SaveBlock* block = calloc(1, sizeof(SaveBlock));
+    if (coded_size > size - reader.pos) {
+        printf("! State: truncated\n");
+        free(block);
+        return 0;
+    }
+    if (flags & SAVESTATE_RAW) {
+        memcpy(block, data + reader.pos, sizeof(SaveBlock));
+    } else if (!framecodec_decode(data + reader.pos, coded_size, (Uint8*) block, sizeof(SaveBlock))) {
+        printf("! State: truncated\n");
+        free(block);
+        return 0;
+    }
+    reader.pos += coded_size;
+
+    int top = lua_gettop(L);
+    lua_pushcfunction(L, savestate_load_protected);
+    lua_pushlightuserdata(L, &reader);
+    if (lua_pcall(L, 1, 0, 0) != LUA_OK) {
+        printf("! State: couldn't load, %s\n", lua_tostring(L, -1));
+        lua_settop(L, top);
+        free(block);
+        return 0;
+    }
+    lua_settop(L, top);
+
+    Screen* screen = cart->screen;
+    memcpy(screen->pixels, block->pixels, SCREEN_BUFFER_SIZE);
+    memcpy(screen->colors, block->colors, sizeof(screen->colors));
+    screen->raster = block->raster;
+    memcpy(screen->draw_palette, block->draw_palette, sizeof(screen->draw_palette));
+    screen->transparent = block->transparent;
+    screen->camera_x = block->camera[0];
+    screen->camera_y = block->camera[1];
+    screen_clip(screen, block->clip[0], block->clip[1], block->clip[2] - block->clip[0] + 1, block->clip[3] - block->clip[1] + 1);
+    memcpy(cart->memory.ram, block->ram, MEMORY_RAM_SIZE);
+    cart->input = block->input;
+    cart->update_time = block->update_time;
+    free(block);
+
+    return 1;
+}
+
+int savestate_write(const SaveState* state, const char* filename) {
+    FILE* file = fopen(filename, "wb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    int ok = fwrite(state->data, 1, state->size, file) == state->size;
+    return fclose(file) == 0 && ok;
+}
+
+SaveState* savestate_read(const char* filename) {
+    FILE* file = fopen(filename, "rb");
+    if (file == NULL) {
+        return NULL;
+    }
+
+    SaveState* state = malloc(sizeof(SaveState));
+    memset(state, 0, sizeof(SaveState));
+
+    Uint8 chunk[4096];
+    size_t got;
+    while ((got = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+        save_bytes(state, chunk, got);
+    }
+    fclose(file);
+
+    return state;
+}
+
+void savestate_free(SaveState* state) {
+    if (state != NULL) {
+        free(state->data);
+        free(state);
+    }
+}
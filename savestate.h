@@ -0,0 +1,47 @@
+#ifndef SAVESTATE_H
+#define SAVESTATE_H
+
+#include <stddef.h>
+
+#include "SDL.h"
+
+#include "cart.h"
+
+#define SAVESTATE_MAX_DEPTH 4000 // nesting of tables and closures, bounds the C stack used
+
+// Flags of savestate_save
+#define SAVESTATE_RAW 0x01 // the screen and RAM as they are, at a fixed offset, for states diffed against each other
+
+// Snapshot of a running cart: the screen, the memory map's RAM and everything reachable
+// from the Lua globals, i.e. tables, closures with their upvalues (shared ones stay shared),
+// strings and numbers. C functions and userdata, e.g. math.floor or io.stdout, are saved by
+// their name under _G and looked up again when loading.
+// Coroutines and C closures created by the cart (e.g. string.gmatch iterators) can't be saved.
+//
+// Format: "VESS", version (u8), flags (u8), the screen and RAM delta coded against zeros with
+// framecodec (raw with SAVESTATE_RAW), then the global table as a tree of tagged values in
+// which every table, closure and string appears once and is referenced by number afterwards. Functions are stored as lua_dump
+// chunks, one per prototype. States only load in the build and cart they were saved from.
+// Those chunks are loaded as they are and Lua doesn't verify bytecode, so states are trusted
+// input: a crafted one can crash the emulator or run any code, only load states it wrote.
+typedef struct SaveState {
+    Uint8* data;
+    size_t size;
+    size_t capacity;
+} SaveState;
+
+// Returns NULL and prints why if the cart holds something that can't be saved
+SaveState* savestate_save(Cart* cart, int flags);
+
+// Replaces the state of the cart, which has to run the same script.
+// Returns 0 and leaves the cart as it was if the data isn't a state that loads into it.
+int savestate_load(Cart* cart, const Uint8* data, size_t size);
+
+// Both return 0 / NULL on failure
+int savestate_write(const SaveState* state, const char* filename);
+
+SaveState* savestate_read(const char* filename);
+
+void savestate_free(SaveState* state);
+
+#endif
@@ -0,0 +1,282 @@
+#include "screenshot.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+// Deflate output: a bit stream written least significant bit first
+typedef struct PngBits {
+    Uint8* data;
+    size_t size;
+    Uint32 bits;
+    int bit_count;
+} PngBits;
+
+static void png_put_bits(PngBits* out, Uint32 value, int count) {
+    out->bits |= value << out->bit_count;
+    out->bit_count += count;
+
+    while (out->bit_count >= 8) {
+        out->data[out->size++] = out->bits & 0xFF;
+        out->bits >>= 8;
+        out->bit_count -= 8;
+    }
+}
+
+// Huffman codes go most significant bit first
+static void png_put_code(PngBits* out, Uint32 code, int length) {
+    Uint32 reversed = 0;
+    for (int i = 0; i < length; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    png_put_bits(out, reversed, length);
+}
+
+// fixed Huffman code of a literal/length symbol
+static void png_put_symbol(PngBits* out, int symbol) {
+    if (symbol < 144) {
+        png_put_code(out, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        png_put_code(out, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        png_put_code(out, symbol - 256, 7);
+    } else {
+        png_put_code(out, 0xC0 + symbol - 280, 8);
+    }
+}
+
+static const Uint16 png_length_base[29] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+static const Uint8 png_length_extra[29] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+static const Uint16 png_distance_base[30] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577};
+static const Uint8 png_distance_extra[30] = {0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static void png_put_match(PngBits* out, int length, int distance) {
+    int code = 28;
+    while (png_length_base[code] > length) {
+        code--;
+    }
+    png_put_symbol(out, 257 + code);
+    png_put_bits(out, length - png_length_base[code], png_length_extra[code]);
+
+    code = 29;
+    while (png_distance_base[code] > distance) {
+        code--;
+    }
+    png_put_code(out, code, 5);
+    png_put_bits(out, distance - png_distance_base[code], png_distance_extra[code]);
+}
+
+// Compresses with a single fixed Huffman block. Pixel art mostly repeats the byte
+// before it or the row above it, so those are the only two matches tried.
+static void png_deflate(PngBits* out, const Uint8* in, size_t size, int stride) {
+    png_put_bits(out, 1, 1); // last block
+    png_put_bits(out, 1, 2); // fixed Huffman codes
+
+    size_t i = 0;
+    while (i < size) {
+        int best_length = 0;
+        int best_distance = 0;
+        int distances[2] = {1, stride};
+
+        for (int d = 0; d < 2; d++) {
+            size_t distance = distances[d];
+            if (distance > i) {
+                continue;
+            }
+
+            int length = 0;
+            while (length < 258 && i + length < size && in[i + length] == in[i + length - distance]) {
+                length++;
+            }
+
+            if (length > best_length) {
+                best_length = length;
+                best_distance = distance;
+            }
+        }
+
+        if (best_length >= 3) {
+            png_put_match(out, best_length, best_distance);
+            i += best_length;
+        } else {
+            png_put_symbol(out, in[i]);
+            i++;
+        }
+    }
+
+    png_put_symbol(out, 256); // end of block
+    if (out->bit_count > 0) {
+        png_put_bits(out, 0, 8 - out->bit_count);
+    }
+}
+
+static Uint32 png_crc(Uint32 crc, const Uint8* data, size_t size) {
+    static Uint32 table[256];
+    static int table_ready = 0;
+
+    if (!table_ready) {
+        for (Uint32 n = 0; n < 256; n++) {
+            Uint32 c = n;
+            for (int k = 0; k < 8; k++) {
+                c = c & 1 ? 0xEDB88320 ^ (c >> 1) : c >> 1;
+            }
+            table[n] = c;
+        }
+        table_ready = 1;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+static void png_put_u32(Uint8* out, Uint32 value) {
+    out[0] = value >> 24;
+    out[1] = value >> 16;
+    out[2] = value >> 8;
+    out[3] = value;
+}
+
+static void png_write_chunk(FILE* file, const char* type, const Uint8* data, Uint32 size) {
+    Uint8 header[8];
+    Uint8 crc[4];
+
+    png_put_u32(header, size);
+    memcpy(header + 4, type, 4);
+    png_put_u32(crc, png_crc(png_crc(0, header + 4, 4), data, size));
+
+    fwrite(header, 1, 8, file);
+    fwrite(data, 1, size, file);
+    fwrite(crc, 1, 4, file);
+}
+
+static int screenshot_write(const FrameSnapshot* frame, int scale, const char* filename) {
+    int width = SCREEN_WIDTH * scale;
+    int height = SCREEN_HEIGHT * scale;
+    int stride = 1 + width / 2; // filter byte + two pixels per byte
+    size_t size = (size_t) stride * height;
+
+    Uint8 indices[SCREEN_WIDTH * SCREEN_HEIGHT];
+    framequeue_unpack(frame, indices);
+
+    // filter type 0 rows, the first pixel of each byte in the high nibble
+    Uint8* raw = malloc(size);
+    for (int y = 0; y < height; y++) {
+        Uint8* row = raw + (size_t) y * stride;
+        const Uint8* source = indices + (y / scale) * SCREEN_WIDTH;
+        row[0] = 0;
+        for (int x = 0; x < width; x += 2) {
+            row[1 + x / 2] = (source[x / scale] << 4) | source[(x + 1) / scale];
+        }
+    }
+
+    // worst case of fixed Huffman is 9 bits per byte
+    PngBits zlib;
+    memset(&zlib, 0, sizeof(PngBits));
+    zlib.data = malloc(size + size / 8 + 64);
+    zlib.data[zlib.size++] = 0x78;
+    zlib.data[zlib.size++] = 0x01;
+    png_deflate(&zlib, raw, size, stride);
+
+    Uint32 a = 1;
+    Uint32 b = 0;
+    for (size_t i = 0; i < size; i++) {
+        a = (a + raw[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    png_put_u32(zlib.data + zlib.size, (b << 16) | a);
+    zlib.size += 4;
+
+    FILE* file = fopen(filename, "wb");
+    if (file != NULL) {
+        Uint8 ihdr[13];
+        Uint8 plte[16 * 3];
+
+        png_put_u32(ihdr, width);
+        png_put_u32(ihdr + 4, height);
+        ihdr[8] = 4; // bit depth
+        ihdr[9] = 3; // indexed color
+        ihdr[10] = 0;
+        ihdr[11] = 0;
+        ihdr[12] = 0;
+
+        for (int i = 0; i < 16; i++) {
+            plte[i * 3] = frame->colors[i].r;
+            plte[i * 3 + 1] = frame->colors[i].g;
+            plte[i * 3 + 2] = frame->colors[i].b;
+        }
+
+        fwrite("\x89PNG\r\n\x1a\n", 1, 8, file);
+        png_write_chunk(file, "IHDR", ihdr, sizeof(ihdr));
+        png_write_chunk(file, "PLTE", plte, sizeof(plte));
+        png_write_chunk(file, "IDAT", zlib.data, zlib.size);
+        png_write_chunk(file, "IEND", NULL, 0);
+        fclose(file);
+    }
+
+    free(zlib.data);
+    free(raw);
+
+    return file != NULL;
+}
+
+static void screenshot_filename(Screenshotter* shots, unsigned long sequence, char* filename, size_t size) {
+    snprintf(filename, size, "ves_%lu_%lu.png", shots->stamp, sequence);
+}
+
+static int screenshot_thread(void* data) {
+    Screenshotter* shots = data;
+    FrameSnapshot* frame;
+    char filename[64];
+
+    while ((frame = framequeue_peek(shots->queue)) != NULL) {
+        screenshot_filename(shots, frame->sequence, filename, sizeof(filename));
+        if (!screenshot_write(frame, shots->scale, filename)) {
+            printf("! Couldn't write screenshot %s\n", filename);
+        }
+        framequeue_pop(shots->queue);
+    }
+
+    return 0;
+}
+
+Screenshotter* screenshot_start(int scale) {
+    Screenshotter* shots = malloc(sizeof(Screenshotter));
+    memset(shots, 0, sizeof(Screenshotter));
+    shots->scale = scale < 1 ? 1 : scale > SCREENSHOT_MAX_SCALE ? SCREENSHOT_MAX_SCALE : scale;
+    shots->stamp = (unsigned long) time(NULL);
+    shots->queue = framequeue_new(SCREENSHOT_QUEUE_FRAMES);
+    shots->thread = SDL_CreateThread(screenshot_thread, "ves-screenshot", shots);
+
+    if (shots->thread == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create screenshot thread: %s", SDL_GetError());
+        framequeue_free(shots->queue);
+        free(shots);
+        return NULL;
+    }
+
+    return shots;
+}
+
+int screenshot_take(Screenshotter* shots, const Screen* screen, char* filename, size_t size) {
+    unsigned long sequence = framequeue_next_sequence(shots->queue);
+
+    if (!framequeue_push(shots->queue, screen, 0)) {
+        return 0;
+    }
+
+    screenshot_filename(shots, sequence, filename, size);
+    return 1;
+}
+
+void screenshot_stop(Screenshotter* shots) {
+    if (shots != NULL) {
+        framequeue_close(shots->queue);
+        SDL_WaitThread(shots->thread, NULL);
+        framequeue_free(shots->queue);
+        free(shots);
+    }
+}
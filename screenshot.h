@@ -0,0 +1,30 @@
+#ifndef SCREENSHOT_H
+#define SCREENSHOT_H
+
+#include "SDL.h"
+
+#include "framequeue.h"
+#include "nblscreen.h"
+
+#define SCREENSHOT_QUEUE_FRAMES 8
+#define SCREENSHOT_MAX_SCALE 16
+
+// Takes screenshots as 4-bit indexed PNGs. Taking one only copies the framebuffer,
+// encoding and writing happen on a worker thread.
+typedef struct Screenshotter {
+    FrameQueue* queue;
+    SDL_Thread* thread;
+    int scale;
+    unsigned long stamp; // files are named ves_<stamp>_<sequence>.png
+} Screenshotter;
+
+Screenshotter* screenshot_start(int scale);
+
+// Writes the name of the file the screenshot will be saved to into filename.
+// Returns 0 if too many screenshots are still waiting to be written.
+int screenshot_take(Screenshotter* shots, const Screen* screen, char* filename, size_t size);
+
+// Waits for the pending screenshots to be written
+void screenshot_stop(Screenshotter* shots);
+
+#endif
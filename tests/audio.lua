@@ -0,0 +1,13 @@
+-- Audio test: one A 440 Hz square wave for 250 ms on the first frame, then silence.
+-- tests/audio_check.py runs it with the SDL disk driver and checks the samples written.
+
+Audio = NibbleAudio
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+    if frame == 1 then
+        Audio.play(0, Audio.SQUARE, 69, 1, 250)
+    end
+end
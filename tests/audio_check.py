@@ -0,0 +1,49 @@
+#!/usr/bin/env python3
+# Runs tests/audio.lua with the SDL disk driver (SDL_AUDIODRIVER=disk, SDL_DISKAUDIOFILE set by
+# meson) and checks the samples: S16 mono at 44100 Hz, a 250 ms A 440 Hz square wave of one
+# channel at full volume, then silence.
+#   audio_check.py <vesemu> <cart>
+import os
+import struct
+import subprocess
+import sys
+
+RATE = 44100
+PEAK = 32767 // 4  # one channel of four at full volume
+
+vesemu, cart = sys.argv[1], sys.argv[2]
+raw = os.environ['SDL_DISKAUDIOFILE']
+if os.path.exists(raw):
+    os.remove(raw)
+
+# paced so the driver, which writes in real time, sees the note and the silence after it
+subprocess.run([vesemu, '--headless', '--audio', '--fps', '60', '--frames', '60', cart], check=True)
+
+data = open(raw, 'rb').read()
+samples = struct.unpack('<%dh' % (len(data) // 2), data[:len(data) // 2 * 2])
+loud = [i for i, s in enumerate(samples) if s != 0]
+
+errors = []
+if not loud:
+    errors.append('no sound written')
+else:
+    first, last = loud[0], loud[-1]
+    note = samples[first:last + 1]
+    ms = len(note) * 1000 / RATE
+    crossings = sum(1 for a, b in zip(note, note[1:]) if (a < 0) != (b < 0))
+    hz = crossings / 2 / (len(note) / RATE)
+    peak = max(abs(s) for s in note)
+
+    if abs(ms - 250) > 10:
+        errors.append('note lasts %.1f ms instead of 250' % ms)
+    if abs(hz - 440) > 5:
+        errors.append('note is %.1f Hz instead of 440' % hz)
+    if abs(peak - PEAK) > 2:
+        errors.append('peak is %d instead of %d' % (peak, PEAK))
+    if len(samples) - last < RATE // 10:
+        errors.append('less than 100 ms of silence after the note')
+
+for error in errors:
+    print('! Audio test: ' + error)
+print('Audio test: %d samples, %s' % (len(samples), 'failed' if errors else 'ok'))
+sys.exit(1 if errors else 0)
@@ -0,0 +1,35 @@
+-- Golden test: camera and clip applied to every primitive
+-- libs: math
+
+Screen = NibbleScreen
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+    Screen.camera()
+    Screen.clip()
+    Screen.rectfill(0, 0, 127, 127, 1)
+
+    -- a world scrolled by the camera in four clipped views
+    for view = 0, 3 do
+        local vx = (view % 2) * 64
+        local vy = (view // 2) * 64
+        Screen.clip(vx + 2, vy + 2, 60, 60)
+        Screen.camera(frame * (view + 1) - vx, frame - vy)
+        Screen.rectfill(-1000, -1000, 3000, 3000, 2 + view)
+        for i = 0, 20 do
+            Screen.rectfill(i * 40, i * 12, i * 40 + 20, i * 12 + 20, (i + view) % 16)
+            Screen.line(i * 40, 0, i * 40 + 100, 300, (i + 8) % 16)
+            Screen.pset(i * 40 + 10, i * 12 + 10, 15)
+        end
+    end
+
+    -- a clip rectangle partly off the screen, and one of no pixels
+    Screen.camera()
+    Screen.clip(100, 100, 100, 100)
+    Screen.rectfill(0, 0, 127, 127, 9)
+    Screen.clip(10, 10, 0, 0)
+    Screen.rectfill(0, 0, 127, 127, 10)
+    Screen.clip()
+end
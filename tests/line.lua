@@ -0,0 +1,33 @@
+-- Golden test: lines in every direction, short and long, clipped by the screen edges
+-- libs: math
+
+Screen = NibbleScreen
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+    Screen.rectfill(0, 0, 127, 127, 0)
+
+    -- a fan from the center through all octants, drawn from both ends
+    local x = 64 + (frame % 64) - 32
+    for i = 0, 15 do
+        Screen.line(x, 64, i * 8, 0, i)
+        Screen.line(127, i * 8, x, 64, 15 - i)
+        Screen.line(x, 64, 127 - i * 8, 127, i)
+        Screen.line(0, 127 - i * 8, x, 64, 15 - i)
+    end
+
+    for i = 1, 16 do
+        Screen.line(math.random(-64, 191), math.random(-64, 191), math.random(-64, 191), math.random(-64, 191), math.random(1, 15))
+    end
+
+    -- long enough to have their end points clipped
+    Screen.line(-5000, -4000 + frame, 6000, 5000 - frame, 7)
+    Screen.line(3000, -2000, -3000 + frame * 10, 2000, 12)
+
+    -- points, horizontal and vertical lines
+    Screen.line(5, 5, 5, 5, 15)
+    Screen.line(0, 100, 127, 100, 3)
+    Screen.line(100, 127, 100, 0, 4)
+end
@@ -0,0 +1,45 @@
+-- Golden test: cset, draw and display palettes, transparency
+-- libs: math
+
+Screen = NibbleScreen
+
+for c = 0, 15 do
+    Screen.cset(c, c * 17, 255 - c * 17, (c * 53) % 256)
+end
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+    Screen.pal()
+    Screen.rectfill(0, 0, 127, 127, 0)
+
+    -- bars drawn through a rotating draw palette
+    for c = 0, 15 do
+        Screen.pal(c, (c + frame) % 16)
+    end
+    for c = 0, 15 do
+        Screen.rectfill(c * 8, 0, c * 8 + 7, 63, c)
+    end
+    Screen.pal()
+
+    -- transparent colors are left out, with booleans and with numbers
+    Screen.palt(1, true)
+    Screen.palt(2, 1)
+    Screen.palt(3, 0)
+    Screen.palt(4, false)
+    for c = 0, 15 do
+        Screen.line(c * 8, 64, c * 8 + 7, 127, c)
+        Screen.pset(c * 8 + 4, 70, c)
+    end
+    Screen.palt()
+
+    -- a display palette fading every color toward the next one
+    if frame % 120 > 60 then
+        for c = 0, 15 do
+            Screen.pal(c, (c + 1) % 16, 1)
+        end
+    end
+
+    Screen.cset(frame % 16, frame % 256, (frame * 3) % 256, (frame * 7) % 256)
+end
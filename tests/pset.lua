@@ -0,0 +1,22 @@
+-- Golden test: pset in every color, on and off the screen
+-- libs: math
+
+Screen = NibbleScreen
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+    if frame % 60 == 1 then
+        Screen.rectfill(0, 0, 127, 127, 0)
+    end
+
+    for i = 1, 200 do
+        Screen.pset(math.random(-8, 135), math.random(-8, 135), math.random(0, 15))
+    end
+
+    -- a diagonal walking across the screen and past its edges
+    for c = 0, 15 do
+        Screen.pset(frame % 160 - 16 + c, c * 8, c)
+    end
+end
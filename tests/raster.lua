@@ -0,0 +1,27 @@
+-- Golden test: palettes and offsets of each line
+-- libs: math
+
+Screen = NibbleScreen
+
+for p = 1, 15 do
+    for c = 0, 15 do
+        Screen.palcset(p, c, (p * 16 + c * 4) % 256, (c * 16) % 256, (p * c * 5) % 256)
+    end
+end
+
+for x = 0, 127 do
+    Screen.line(x, 0, x, 127, x // 8)
+end
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+
+    for y = 0, 127 do
+        Screen.linepal(y, (y // 8 + frame) % 16)
+        Screen.lineoffset(y, math.floor(math.sin((y + frame) / 10) * 12))
+    end
+
+    Screen.pset(frame % 128, frame % 128, 15)
+end
@@ -0,0 +1,25 @@
+-- Golden test: rectfill with corners in any order, partly or entirely off the screen
+-- libs: math
+
+Screen = NibbleScreen
+
+frame = 0
+
+function _screen_draw(delta)
+    frame = frame + 1
+    Screen.rectfill(0, 0, 127, 127, frame % 16)
+
+    for i = 1, 24 do
+        local x1 = math.random(-40, 167)
+        local y1 = math.random(-40, 167)
+        local x2 = math.random(-40, 167)
+        local y2 = math.random(-40, 167)
+        Screen.rectfill(x1, y1, x2, y2, math.random(0, 15))
+    end
+
+    -- single pixels, lines and a rectangle sliding off every edge
+    Screen.rectfill(10, 10, 10, 10, 7)
+    Screen.rectfill(20, 5, 20, 50, 8)
+    Screen.rectfill(5, 60, 90, 60, 9)
+    Screen.rectfill(frame % 200 - 50, frame % 150 - 20, frame % 200 - 20, frame % 150 + 10, 10)
+end
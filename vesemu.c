@@ -1,11 +1,13 @@
 /* Helpful article: https://lucasklassmann.com/blog/2019-02-02-how-to-embeddeding-lua-in-c/*/
 
+#include <stddef.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
 
 #include <sys/time.h>
+#include <time.h>
 
 #include <lua.h>
 #include <lauxlib.h>
@@ -13,85 +15,930 @@
 
 #include "SDL.h"
 
+#include "alloccount.h"
+#include "audio.h"
+#include "cart.h"
+#include "filewatch.h"
+#include "framestream.h"
+#include "gif.h"
+#include "golden.h"
+#include "host.h"
+#include "input.h"
 #include "nblscreen.h"
+#include "pipeline.h"
+#include "profiler.h"
+#include "rawvideo.h"
+#include "replay.h"
+#include "rewind.h"
+#include "savestate.h"
+#include "screenshot.h"
+#include "watchdog.h"
+
+#define MAX_CARTS 64
+#define DEFAULT_FRAMESKIP 4
+#define DEFAULT_STATE_FILE "ves.state"
+#define ALLOC_TEST_WARMUP_FRAMES 60 // frames allowed to allocate before --alloc-test starts counting
+#define ALLOC_TEST_MAX_REPORTS 10 // frames reported by --alloc-test, the rest are only counted
 
 // equivalent to ceil(x / y)
 int ceildivide(int x, int y) {
     return 1 + ((x - 1) / y);
 }
 
-int main(int argc, char** argv) {
-    printf("This is VES Emulator\n");
+void usage(const char* program) {
+    printf("Usage: %s [options] <filename>\n", program);
+    printf("       %s --host <instances> [options] <filename>...\n", program);
+    printf("  --budget-ms <n>          time budget of a Lua callback in ms (default %d, 0 = unlimited)\n", WATCHDOG_DEFAULT_TIME_MS);
+    printf("  --budget-insns <n>       instruction budget of a Lua callback (default 0 = unlimited)\n");
+    printf("  --watchdog <abort|degrade>  what to do with a callback over budget (default abort)\n");
+    printf("  --headless               run without a window\n");
+    printf("  --mute                   don't open an audio device\n");
+    printf("  --audio                  open an audio device even when headless, e.g. with SDL_AUDIODRIVER=disk\n");
+    printf("  --pipeline               run Lua and rasterization on a thread of their own, presenting on the main one\n");
+    printf("  --frames <n>             stop after n frames (default 0 = run until closed, 600 in host mode)\n");
+    printf("  --delta <ms>             pass a fixed delta to _screen_draw instead of the measured one\n");
+    printf("  --update-hz <n>          rate of _update in carts defining _update and _draw (default %d)\n", CART_DEFAULT_UPDATE_HZ);
+    printf("  --fps <n>                pace the loop to n frames per second (default 0 = as fast as possible)\n");
+    printf("  --frameskip <n>          frames run without presenting to catch up with --fps before slowing down (default %d)\n", DEFAULT_FRAMESKIP);
+    printf("  --host <n>               run n headless instances of the given carts and report throughput\n");
+    printf("  --threads <n>            worker threads in host mode (default: one per logical CPU)\n");
+    printf("  --profile <file>         sample the Lua callbacks and write collapsed stacks for flamegraph tools to file\n");
+    printf("  --profile-interval <n>   Lua instructions between two samples (default %d)\n", PROFILER_DEFAULT_INTERVAL);
+    printf("  --alloc-test             fail if the loop allocates after a warm-up of %d frames (runs 600 frames unless --frames is given)\n", ALLOC_TEST_WARMUP_FRAMES);
+    printf("  --watch                  reload the cart when its file changes, keeping the window\n");
+    printf("  --keep-screen            start reloaded carts on the screen left by the previous one instead of a blank one\n");
+    printf("  --record <file>          record the delta and buttons of every frame to file\n");
+    printf("  --replay <file>          replay a recording instead of using the clock and keyboard\n");
+    printf("  --golden <file>          run headless and compare framebuffer hashes to a golden file, fail on a difference\n");
+    printf("  --golden-write <file>    run headless and write framebuffer hashes to a golden file\n");
+    printf("  --golden-every <n>       hash every nth frame when writing a golden file (default 1)\n");
+    printf("  --state <file>           file F5 saves the state of the cart to and F8 loads it from (default %s)\n", DEFAULT_STATE_FILE);
+    printf("  --loadstate <file>       load a saved state before the first frame\n");
+    printf("  --savestate <file>       save the state of the cart once the last frame ran\n");
+    printf("  --rewind <MB>            keep a history of up to MB megabytes to rewind while Backspace is held (default 0 = off)\n");
+    printf("  --rewind-keyframe <n>    frames between full snapshots in the rewind history (default %d)\n", REWIND_DEFAULT_KEYFRAME);
+    printf("  --shotscale <n>          upscale F12 and NibbleSystem.screenshot PNGs n times (default %d)\n", SCREEN_SCALE_RATIO);
+    printf("  --gif <file>             record the screen to an animated GIF (F9 toggles recording)\n");
+    printf("  --rawvideo <file>        write every frame to a file or pipe (- for stdout) for an external encoder\n");
+    printf("  --rawformat <rgb24|y4m>  format of --rawvideo (default rgb24)\n");
+    printf("  --rawscale <n>           upscale --rawvideo frames n times (default 1)\n");
+    printf("  --rawfps <n>             frame rate written in the y4m header (default 60)\n");
+    printf("  --rawbuffer <n>          frames buffered for a slow consumer before dropping (default %d)\n", RAWVIDEO_DEFAULT_QUEUE_FRAMES);
+    printf("  --stream <path|tcp:port> stream frames to a vesview viewer over a Unix socket or loopback TCP\n");
+}
 
-    if (argc != 2) {
-        printf("Usage: %s <filename>\n", argv[0]);
-        return 1;
-    }
+// Everything one frame of a cart touches, shared by the serial and the pipelined loops
+typedef struct Session {
+    Screen* screen;
+    Cart* cart;
+    Screenshotter* screenshots;
+    Replay* replay;
+    Replay* record;
+    GifRecorder* gif;
+    RawVideo* rawvideo;
+    FrameStream* stream;
+    Golden* golden;
+    Rewind* rewind;
+    const char* state_filename;
+
+    // --watch
+    FileWatch* watch;
+    const CartOptions* options; // of the carts reloaded
+    int keep_screen; // reloaded carts start on the screen left by the previous one
+    int broken; // the cart stopped on an error, frames are skipped until it gets fixed
+    unsigned int frames; // 0 = run until closed
+    int delta_set;
+    unsigned int fixed_delta;
 
-    char* filename = argv[1];
+    // pacing, only with --fps
+    unsigned int fps;
+    int frameskip; // frames run back to back to catch up before giving up and slowing down
+    int skipping;
+    unsigned int delta_remainder; // the frame period in ms times fps, left over from previous deltas
+    unsigned int clock_remainder; // microseconds of the clock below a whole ms, carried to the next delta
+    Uint64 next_frame; // performance counter when the next frame is due
+    unsigned long skipped;
+    unsigned long slowdowns;
+    struct timeval tv_draw;
+    unsigned long stepped;
+    Uint64 finished; // performance counter at the end of the last rasterized frame
 
-    ves_screen = screen_init();
-	
-    lua_State* L = luaL_newstate();
+    // written by the thread handling SDL events, read by the thread running the cart
+    SDL_atomic_t buttons;
+    SDL_atomic_t rewinding; // Backspace held
+    SDL_atomic_t gif_toggle;
+    SDL_atomic_t screenshot;
+    SDL_atomic_t save_state;
+    SDL_atomic_t load_state;
+    SDL_atomic_t quit;
+    SDL_atomic_t done; // set by the cart thread when it stops on its own
+    SDL_atomic_t blit_ticks; // of the last presented frame
 
-    luaL_openlibs(L);
+    Pipeline pipeline;
+    unsigned long presented;
+    Uint64 first_frame; // performance counter once the first frame was presented, or run when headless
+    Uint64 latency_ticks; // from the end of rasterization to the end of the present
+    Uint64 latency_max;
+
+    // --alloc-test
+    int alloc_test;
+    unsigned long lua_allocs; // counts at the start of the previous step
+    unsigned long sdl_allocs;
+    unsigned long alloc_frames; // frames past the warm-up that allocated
+} Session;
+
+// Runs on the thread owning the window
+static void session_poll_events(Session* session) {
+    SDL_Event event;
+
+    while (SDL_PollEvent(&event)) {
+        if (event.type == SDL_QUIT) {
+            SDL_AtomicSet(&session->quit, 1);
+        } else if (event.type == SDL_KEYDOWN && !event.key.repeat) {
+            if (event.key.keysym.sym == SDLK_F9) {
+                SDL_AtomicSet(&session->gif_toggle, 1);
+            } else if (event.key.keysym.sym == SDLK_F12) {
+                SDL_AtomicSet(&session->screenshot, 1);
+            } else if (event.key.keysym.sym == SDLK_F5) {
+                SDL_AtomicSet(&session->save_state, 1);
+            } else if (event.key.keysym.sym == SDLK_F8) {
+                SDL_AtomicSet(&session->load_state, 1);
+            }
+        }
+    }
 
-    // Screen library
-    lua_newtable(L);
-    luaL_setfuncs(L, ScreenLib, 0);
-    lua_setglobal(L, "NibbleScreen");
+    SDL_AtomicSet(&session->buttons, input_read_keyboard());
+    SDL_AtomicSet(&session->rewinding, SDL_GetKeyboardState(NULL)[SDL_SCANCODE_BACKSPACE]);
+}
 
-    // Allows only math and string libraries to be used
-    // luaopen_io(L);
-    // luaopen_math(L);
-    // luaopen_string(L);
+static void session_save_state(Session* session, const char* filename) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    SaveState* state = savestate_save(session->cart, 0);
+    if (state == NULL) {
+        return;
+    }
+    double ms = (double) (SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
 
-    // run everything not inside of a function
-    if (luaL_dofile(L, filename) == LUA_OK) {
-        lua_pop(L, lua_gettop(L));
+    if (savestate_write(state, filename)) {
+        printf("State: saved %lu bytes to %s in %.3f ms\n", (unsigned long) state->size, filename, ms);
     } else {
-        printf("! Lua error: %s\n", lua_tostring(L, lua_gettop(L)));
+        printf("! State: couldn't write %s\n", filename);
     }
+    savestate_free(state);
+}
 
-    // main application loop
-    SDL_Event event;
+static int session_load_state(Session* session, const char* filename) {
+    SaveState* state = savestate_read(filename);
+    if (state == NULL) {
+        printf("! State: couldn't read %s\n", filename);
+        return 0;
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+    int loaded = savestate_load(session->cart, state->data, state->size);
+    double ms = (double) (SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency();
+
+    if (loaded) {
+        printf("State: loaded %lu bytes from %s in %.3f ms\n", (unsigned long) state->size, filename, ms);
+    }
+    savestate_free(state);
+    return loaded;
+}
+
+// Key presses that act on outputs fed by the cart thread are carried out there
+static void session_handle_keys(Session* session) {
+    if (SDL_AtomicSet(&session->gif_toggle, 0)) {
+        if (session->gif == NULL) {
+            char gif_name[64];
+            snprintf(gif_name, sizeof(gif_name), "ves_%lu.gif", (unsigned long) time(NULL));
+            if ((session->gif = gif_start(gif_name)) != NULL) {
+                printf("GIF: recording to %s\n", gif_name);
+            }
+        } else {
+            gif_stop(session->gif);
+            session->gif = NULL;
+            printf("GIF: recording stopped\n");
+        }
+    }
+
+    if (SDL_AtomicSet(&session->screenshot, 0)) {
+        char filename[64];
+        if (session->screenshots != NULL && screenshot_take(session->screenshots, session->screen, filename, sizeof(filename))) {
+            printf("Screenshot: %s\n", filename);
+        }
+    }
+
+    if (SDL_AtomicSet(&session->save_state, 0)) {
+        session_save_state(session, session->state_filename);
+    }
+
+    if (SDL_AtomicSet(&session->load_state, 0)) {
+        session_load_state(session, session->state_filename);
+    }
+}
+
+// Allocations since the start of the previous step, i.e. during the last frame with its
+// present and event handling when they run on the same thread
+static void session_count_allocations(Session* session) {
+    unsigned long lua_allocs = session->cart->allocs - session->lua_allocs;
+    unsigned long sdl_allocs = alloccount_sdl() - session->sdl_allocs;
+    session->lua_allocs += lua_allocs;
+    session->sdl_allocs += sdl_allocs;
+
+    if (session->stepped <= ALLOC_TEST_WARMUP_FRAMES || lua_allocs + sdl_allocs == 0) {
+        return;
+    }
+
+    if (session->alloc_frames++ < ALLOC_TEST_MAX_REPORTS) {
+        printf("! Allocations: frame %lu made %lu Lua and %lu SDL allocations\n", session->stepped - 1, lua_allocs, sdl_allocs);
+    }
+}
+
+// Swaps in a fresh instance of the cart, run from the file as it is now, between two frames.
+// The screen and its window stay, the sound stops. A cart that doesn't load leaves the running
+// one in place with its envelopes, but its patterns and tracks are gone along with the sound.
+static void session_reload(Session* session) {
+    Uint64 start = SDL_GetPerformanceCounter();
+    Screen* screen = session->screen;
+
+    // everything before the window is what carts draw to, to put back if the new cart fails
+    Screen drawn;
+    memcpy(&drawn, screen, offsetof(Screen, window));
+    if (!session->keep_screen) {
+        screen_reset(screen);
+    }
+
+    // notes held and tracks looping would otherwise play on under the new cart, which
+    // starts its own from its main chunk. The reset has to come before the main chunk runs,
+    // so the running cart loses its sound too when the new one doesn't load.
+    Audio* audio = session->options->audio;
+    AudioEnvelope envelopes[AUDIO_CHANNELS];
+    if (audio != NULL) {
+        memcpy(envelopes, audio->envelopes, sizeof(envelopes));
+        audio_reset(audio);
+    }
+
+    Cart* cart = cart_new(session->cart->filename, screen, session->options);
+    if (cart->main_status != LUA_OK) {
+        printf("! Reload: %s doesn't load, %s\n", cart->filename,
+            session->broken ? "waiting for a fix" : audio != NULL ? "keeping the running cart, its patterns stopped" : "keeping the running cart");
+        cart_free(cart);
+        memcpy(screen, &drawn, offsetof(Screen, window));
+        // and whatever the failed main chunk got to start stops too
+        if (audio != NULL) {
+            audio_reset(audio);
+            memcpy(audio->envelopes, envelopes, sizeof(envelopes));
+        }
+        return;
+    }
+
+    cart->screenshots = session->screenshots;
+    cart_free(session->cart);
+    session->cart = cart;
+    session->broken = 0;
+    session->lua_allocs = cart->allocs;
+
+    // the history is made of states of the cart that was just dropped
+    if (session->rewind != NULL) {
+        rewind_clear(session->rewind);
+    }
+
+    printf("Reload: %s in %.2f ms\n", cart->filename, (double) (SDL_GetPerformanceCounter() - start) * 1000 / SDL_GetPerformanceFrequency());
+}
+
+// Runs one frame of the cart and feeds the outputs. Returns 0 when the session is over.
+static int session_step(Session* session) {
     struct timeval tv_draw_current;
     unsigned int delta_draw;
-    memset(&tv_draw_current, 0, sizeof(struct timeval));
+    Uint8 buttons = SDL_AtomicGet(&session->buttons);
+
+    if (session->alloc_test) {
+        session_count_allocations(session);
+    }
+
+    if (SDL_AtomicGet(&session->quit) || (session->frames != 0 && session->stepped >= session->frames)) {
+        return 0;
+    }
+
+    session_handle_keys(session);
+
+    if (session->watch != NULL && filewatch_changed(session->watch)) {
+        session_reload(session);
+    }
+
+    // frames shorter than a ms get a delta of 0, the time they took goes to a later one,
+    // so the deltas add up to the time passed and _update keeps its rate at any frame rate
+    gettimeofday(&tv_draw_current, NULL);
+    Uint64 elapsed = (Uint64) (tv_draw_current.tv_sec - session->tv_draw.tv_sec) * 1000000
+        + tv_draw_current.tv_usec - session->tv_draw.tv_usec + session->clock_remainder;
+    delta_draw = elapsed / 1000;
+    session->clock_remainder = elapsed % 1000;
+    session->tv_draw = tv_draw_current;
+    if (session->delta_set) {
+        delta_draw = session->fixed_delta;
+    } else if (session->fps > 0) {
+        // one frame period, spread over the frames so the deltas add up to real time
+        session->delta_remainder += 1000;
+        delta_draw = session->delta_remainder / session->fps;
+        session->delta_remainder -= delta_draw * session->fps;
+    }
+
+    // the frame shown is restored from the history instead of run, nothing is recorded
+    if (session->rewind != NULL && SDL_AtomicGet(&session->rewinding)) {
+        if (rewind_step_back(session->rewind, session->cart) < 0) {
+            printf("! Rewind: turned off\n");
+            rewind_free(session->rewind);
+            session->rewind = NULL;
+        }
+        session->finished = SDL_GetPerformanceCounter();
+        return 1;
+    }
+
+    // the last frame drawn stays on screen until the file is fixed
+    if (session->broken) {
+        session->finished = SDL_GetPerformanceCounter();
+        return 1;
+    }
+
+    if (session->replay != NULL && !replay_read_frame(session->replay, &delta_draw, &buttons)) {
+        return 0;
+    }
+
+    if (session->record != NULL) {
+        replay_write_frame(session->record, delta_draw, buttons);
+    }
+
+    input_update(&session->cart->input, buttons);
+
+    // reported through stat() for the frame about to be drawn, see screen_stats_rollover
+    session->screen->stats.blit_ticks = SDL_AtomicSet(&session->blit_ticks, 0);
+
+    if (cart_draw(session->cart, delta_draw)) {
+        // while watching, an error only stops the cart until the next change of its file
+        if (session->watch == NULL) {
+            return 0;
+        }
+        printf("! Reload: %s stopped, waiting for a fix\n", session->cart->filename);
+        session->broken = 1;
+        return 1;
+    }
+    session->finished = SDL_GetPerformanceCounter();
+
+    if (session->rewind != NULL && !rewind_push(session->rewind, session->cart)) {
+        printf("! Rewind: turned off\n");
+        rewind_free(session->rewind);
+        session->rewind = NULL;
+    }
+
+    if (session->golden != NULL) {
+        golden_frame(session->golden, session->screen, session->stepped);
+    }
+    session->stepped++;
+
+    if (session->gif != NULL) {
+        gif_push(session->gif, session->screen, delta_draw);
+    }
+
+    if (session->rawvideo != NULL) {
+        rawvideo_push(session->rawvideo, session->screen, delta_draw);
+    }
+
+    if (session->stream != NULL) {
+        framestream_push(session->stream, session->screen, delta_draw);
+    }
+
+    return 1;
+}
+
+static void session_present(Session* session, const Uint8* pixels, const Color* colors, const ScreenRaster* raster, Uint64 finished) {
+    Uint64 ticks = screen_blit_pixels(session->screen, pixels, colors, raster);
+    SDL_RenderPresent(session->screen->renderer);
+
+    SDL_AtomicSet(&session->blit_ticks, ticks > SDL_MAX_SINT32 ? SDL_MAX_SINT32 : (int) ticks);
+
+    Uint64 latency = SDL_GetPerformanceCounter() - finished;
+    session->latency_ticks += latency;
+    if (latency > session->latency_max) {
+        session->latency_max = latency;
+    }
+    if (session->presented++ == 0) {
+        session->first_frame = SDL_GetPerformanceCounter();
+    }
+}
+
+// Moves the deadline one frame period further after a frame ran.
+// Returns 1 when the loop is behind and should run the next frame right away, skipping
+// the present. After frameskip frames in a row it gives up catching up and slows down instead.
+static int session_fall_behind(Session* session) {
+    if (session->fps == 0) {
+        return 0;
+    }
+
+    Uint64 now = SDL_GetPerformanceCounter();
+    if (session->next_frame == 0) {
+        session->next_frame = now;
+    }
+    session->next_frame += SDL_GetPerformanceFrequency() / session->fps;
+
+    if (now <= session->next_frame) {
+        session->skipping = 0;
+        return 0;
+    }
+
+    if (session->skipping < session->frameskip) {
+        session->skipping++;
+        session->skipped++;
+        return 1;
+    }
+
+    session->skipping = 0;
+    session->slowdowns++;
+    session->next_frame = now;
+    return 0;
+}
+
+// Sleeps until the next frame is due
+static void session_wait(Session* session) {
+    Uint64 now = SDL_GetPerformanceCounter();
 
+    if (session->fps > 0 && now < session->next_frame) {
+        SDL_Delay((session->next_frame - now) * 1000 / SDL_GetPerformanceFrequency());
+    }
+}
+
+// Lua, rasterization and presenting one after another on the main thread
+static void session_run_serial(Session* session) {
     while (1) {
-        SDL_PollEvent(&event);
-        if (event.type == SDL_QUIT) {
+        session_poll_events(session);
+        if (!session_step(session)) {
             break;
         }
+        if (session_fall_behind(session)) {
+            continue;
+        }
+        session_present(session, session->screen->pixels, session->screen->colors, &session->screen->raster, session->finished);
+        session_wait(session);
+    }
+}
+
+static void session_run_headless(Session* session) {
+    while (session_step(session)) {
+        if (session->first_frame == 0) {
+            session->first_frame = session->finished;
+        }
+        if (!session_fall_behind(session)) {
+            session_wait(session);
+        }
+    }
+}
+
+static int session_thread(void* data) {
+    Session* session = data;
+
+    // frames are never presented from here, falling behind only means not waiting
+    while (session_step(session)) {
+        pipeline_publish(&session->pipeline, session->screen);
+        if (!session_fall_behind(session)) {
+            session_wait(session);
+        }
+    }
+
+    SDL_AtomicSet(&session->done, 1);
+    return 0;
+}
+
+// Lua and rasterization of frame N + 1 on a worker thread while the main thread presents frame N.
+// The main thread keeps the window since SDL wants events and rendering on the thread that created it.
+static void session_run_pipelined(Session* session) {
+    pipeline_init(&session->pipeline);
+
+    SDL_Thread* thread = SDL_CreateThread(session_thread, "ves-cart", session);
+    if (thread == NULL) {
+        SDL_LogError(SDL_LOG_CATEGORY_APPLICATION, "Couldn't create cart thread: %s", SDL_GetError());
+        session_run_serial(session);
+        return;
+    }
+
+    while (!SDL_AtomicGet(&session->done) && !SDL_AtomicGet(&session->quit)) {
+        session_poll_events(session);
+
+        const PipelineFrame* frame = pipeline_acquire(&session->pipeline);
+        if (frame != NULL) {
+            session_present(session, frame->pixels, frame->colors, &frame->raster, frame->finished);
+        } else {
+            SDL_Delay(1);
+        }
+    }
+
+    SDL_AtomicSet(&session->quit, 1);
+    SDL_WaitThread(thread, NULL);
+}
+
+// Arguments and result of cart_new when it runs on a thread of its own at startup
+typedef struct CartLaunch {
+    const char* filename;
+    Screen* screen;
+    const CartOptions* options;
+    Cart* cart;
+} CartLaunch;
 
-        gettimeofday(&tv_draw_current, NULL);
-        delta_draw = (tv_draw_current.tv_sec - ves_screen->tv_draw.tv_sec) * 1000 + (tv_draw_current.tv_usec - ves_screen->tv_draw.tv_usec) / 1000;
-        ves_screen->tv_draw = tv_draw_current;
+static int launch_cart(void* data) {
+    CartLaunch* launch = data;
+    launch->cart = cart_new(launch->filename, launch->screen, launch->options);
+    return 0;
+}
+
+static void startup_report(const Session* session, const CartStartup* startup, Uint64 launched, Uint64 window_ticks, int parallel) {
+    double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+
+    printf("Startup: Lua state %.2f ms, libraries %.2f ms, compile %.2f ms, main chunk %.2f ms",
+        startup->state_ticks * ms_per_tick, startup->libs_ticks * ms_per_tick,
+        startup->compile_ticks * ms_per_tick, startup->main_ticks * ms_per_tick);
+    if (session->screen->window != NULL) {
+        printf(", window %.2f ms%s", window_ticks * ms_per_tick, parallel ? " in parallel" : "");
+    }
+    if (session->first_frame != 0) {
+        printf(", first frame after %.2f ms", (session->first_frame - launched) * ms_per_tick);
+    }
+    printf("\n");
+}
+
+int main(int argc, char** argv) {
+    char* filenames[MAX_CARTS];
+    int filename_count = 0;
+    int headless = 0;
+    int pipelined = 0;
+    unsigned int frames = 0;
+    int frames_set = 0;
+    unsigned int fixed_delta = 0;
+    int delta_set = 0;
+    unsigned int fps = 0;
+    int frameskip = DEFAULT_FRAMESKIP;
+    int host_instances = 0;
+    int host_threads = 0;
+    int alloc_test = 0;
+    int watch = 0;
+    int audio_mode = 0; // 1 = forced on, -1 = muted, 0 = only with a window
+    int keep_screen = 0;
+    char* record_filename = NULL;
+    char* replay_filename = NULL;
+    char* gif_filename = NULL;
+    char* rawvideo_filename = NULL;
+    RawVideoFormat rawvideo_format = RAWVIDEO_RGB24;
+    int rawvideo_scale = 1;
+    unsigned int rawvideo_fps = 60;
+    int rawvideo_buffer = RAWVIDEO_DEFAULT_QUEUE_FRAMES;
+    int shot_scale = SCREEN_SCALE_RATIO;
+    char* stream_address = NULL;
+    char* golden_filename = NULL;
+    int golden_writing = 0;
+    unsigned int golden_every = 1;
+    const char* state_filename = DEFAULT_STATE_FILE;
+    const char* loadstate_filename = NULL;
+    const char* savestate_filename = NULL;
+    int rewind_mb = 0;
+    const char* profile_filename = NULL;
+    unsigned int profile_interval = PROFILER_DEFAULT_INTERVAL;
+    int rewind_keyframe = REWIND_DEFAULT_KEYFRAME;
+    CartOptions options;
+    cart_options_init(&options);
+    Watchdog* watchdog = &options.watchdog;
+
+    // SDL only takes its memory functions before it allocated anything
+    alloccount_install_sdl();
+    Uint64 launched = SDL_GetPerformanceCounter();
 
-        // evaluate draw function: _screen_draw(delta)
-        lua_getglobal(L, "_screen_draw");
-        if (lua_isfunction(L, -1)) {
-            lua_pushinteger(L, delta_draw);
-            if (lua_pcall(L, 1, 0, 0) == LUA_OK) {
-                lua_pop(L, lua_gettop(L));
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--budget-ms") == 0 && i + 1 < argc) {
+            watchdog->time_budget_ms = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--budget-insns") == 0 && i + 1 < argc) {
+            watchdog->insn_budget = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--watchdog") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "abort") == 0) {
+                watchdog->mode = WATCHDOG_ABORT;
+            } else if (strcmp(argv[i], "degrade") == 0) {
+                watchdog->mode = WATCHDOG_DEGRADE;
+            } else {
+                usage(argv[0]);
+                return 1;
+            }
+        } else if (strcmp(argv[i], "--headless") == 0) {
+            headless = 1;
+        } else if (strcmp(argv[i], "--mute") == 0) {
+            audio_mode = -1;
+        } else if (strcmp(argv[i], "--audio") == 0) {
+            audio_mode = 1;
+        } else if (strcmp(argv[i], "--pipeline") == 0) {
+            pipelined = 1;
+        } else if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc) {
+            frames = strtoul(argv[++i], NULL, 10);
+            frames_set = 1;
+        } else if (strcmp(argv[i], "--delta") == 0 && i + 1 < argc) {
+            fixed_delta = strtoul(argv[++i], NULL, 10);
+            delta_set = 1;
+        } else if (strcmp(argv[i], "--update-hz") == 0 && i + 1 < argc) {
+            options.update_hz = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--fps") == 0 && i + 1 < argc) {
+            fps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--frameskip") == 0 && i + 1 < argc) {
+            frameskip = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--host") == 0 && i + 1 < argc) {
+            host_instances = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            host_threads = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--watch") == 0) {
+            watch = 1;
+        } else if (strcmp(argv[i], "--keep-screen") == 0) {
+            keep_screen = 1;
+        } else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            record_filename = argv[++i];
+        } else if (strcmp(argv[i], "--replay") == 0 && i + 1 < argc) {
+            replay_filename = argv[++i];
+        } else if (strcmp(argv[i], "--gif") == 0 && i + 1 < argc) {
+            gif_filename = argv[++i];
+        } else if (strcmp(argv[i], "--rawvideo") == 0 && i + 1 < argc) {
+            rawvideo_filename = argv[++i];
+        } else if (strcmp(argv[i], "--rawformat") == 0 && i + 1 < argc) {
+            i++;
+            if (strcmp(argv[i], "rgb24") == 0) {
+                rawvideo_format = RAWVIDEO_RGB24;
+            } else if (strcmp(argv[i], "y4m") == 0) {
+                rawvideo_format = RAWVIDEO_Y4M;
             } else {
-                printf("! Lua error: %s\n", lua_tostring(L, lua_gettop(L)));
-                break;
+                usage(argv[0]);
+                return 1;
             }
+        } else if (strcmp(argv[i], "--rawscale") == 0 && i + 1 < argc) {
+            rawvideo_scale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rawfps") == 0 && i + 1 < argc) {
+            rawvideo_fps = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--rawbuffer") == 0 && i + 1 < argc) {
+            rawvideo_buffer = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--shotscale") == 0 && i + 1 < argc) {
+            shot_scale = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--golden") == 0 && i + 1 < argc) {
+            golden_filename = argv[++i];
+            golden_writing = 0;
+        } else if (strcmp(argv[i], "--golden-write") == 0 && i + 1 < argc) {
+            golden_filename = argv[++i];
+            golden_writing = 1;
+        } else if (strcmp(argv[i], "--golden-every") == 0 && i + 1 < argc) {
+            golden_every = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--profile") == 0 && i + 1 < argc) {
+            profile_filename = argv[++i];
+        } else if (strcmp(argv[i], "--profile-interval") == 0 && i + 1 < argc) {
+            profile_interval = strtoul(argv[++i], NULL, 10);
+        } else if (strcmp(argv[i], "--alloc-test") == 0) {
+            alloc_test = 1;
+        } else if (strcmp(argv[i], "--rewind") == 0 && i + 1 < argc) {
+            rewind_mb = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--rewind-keyframe") == 0 && i + 1 < argc) {
+            rewind_keyframe = atoi(argv[++i]);
+        } else if (strcmp(argv[i], "--state") == 0 && i + 1 < argc) {
+            state_filename = argv[++i];
+        } else if (strcmp(argv[i], "--loadstate") == 0 && i + 1 < argc) {
+            loadstate_filename = argv[++i];
+        } else if (strcmp(argv[i], "--savestate") == 0 && i + 1 < argc) {
+            savestate_filename = argv[++i];
+        } else if (strcmp(argv[i], "--stream") == 0 && i + 1 < argc) {
+            stream_address = argv[++i];
+        } else if (argv[i][0] != '-' && filename_count < MAX_CARTS) {
+            filenames[filename_count++] = argv[i];
+        } else {
+            usage(argv[0]);
+            return 1;
+        }
+    }
+
+    if (filename_count == 0 || (filename_count > 1 && host_instances <= 0)) {
+        usage(argv[0]);
+        return 1;
+    }
+
+    // started before printing anything since it may take over stdout
+    RawVideo* rawvideo = NULL;
+    if (rawvideo_filename != NULL) {
+        rawvideo = rawvideo_start(rawvideo_filename, rawvideo_format, rawvideo_scale, rawvideo_fps, rawvideo_buffer);
+        if (rawvideo == NULL) {
+            printf("! Couldn't open raw video output %s\n", rawvideo_filename);
+            return 1;
+        }
+    }
+
+    printf("This is VES Emulator\n");
+
+    if (host_instances > 0) {
+        HostConfig config;
+        memset(&config, 0, sizeof(HostConfig));
+        config.filenames = filenames;
+        config.filename_count = filename_count;
+        config.instances = host_instances;
+        config.threads = host_threads;
+        config.frames = frames_set ? frames : 600;
+        config.delta = delta_set ? fixed_delta : 16;
+        config.options = options;
+
+        return host_run(&config) ? 1 : 0;
+    }
+
+    // a recording stores the seed of math.random so the replay takes the same random path
+    Replay* replay = NULL;
+    if (replay_filename != NULL) {
+        if ((replay = replay_play(replay_filename)) == NULL) {
+            printf("! Couldn't read replay %s\n", replay_filename);
+            return 1;
+        }
+        options.seeded = 1;
+        options.seed = replay->seed;
+    }
+
+    Replay* record = NULL;
+    if (record_filename != NULL) {
+        if (!options.seeded) {
+            options.seeded = 1;
+            options.seed = SDL_GetPerformanceCounter();
         }
+        if ((record = replay_record(record_filename, options.seed)) == NULL) {
+            printf("! Couldn't write recording %s\n", record_filename);
+            return 1;
+        }
+    }
+
+    // golden runs have to be reproducible: no window, no clock, no random seed
+    Golden* golden = NULL;
+    if (golden_filename != NULL) {
+        if ((golden = golden_open(golden_filename, golden_writing, golden_every)) == NULL) {
+            printf("! Couldn't %s golden file %s\n", golden_writing ? "write" : "read", golden_filename);
+            return 1;
+        }
+        headless = 1;
+        if (!delta_set) {
+            delta_set = 1;
+            fixed_delta = 16;
+        }
+        if (!frames_set) {
+            frames = 600;
+        }
+        if (!options.seeded) {
+            options.seeded = 1;
+            options.seed = 0;
+        }
+    }
+
+    if (alloc_test && !frames_set) {
+        frames = 600;
+    }
+
+    // not in host mode, the carts there run on several threads
+    Profiler* profiler = NULL;
+    if (profile_filename != NULL) {
+        profiler = options.profiler = profiler_new(profile_interval);
+    }
+
+    Session session;
+    memset(&session, 0, sizeof(Session));
+    session.golden = golden;
+    session.state_filename = state_filename;
+    session.replay = replay;
+    session.record = record;
+    session.frames = frames;
+    session.delta_set = delta_set;
+    session.fixed_delta = fixed_delta;
+    session.fps = fps;
+    session.frameskip = frameskip;
+    session.alloc_test = alloc_test;
+    session.options = &options;
+    session.keep_screen = keep_screen;
+
+    Screen* screen = session.screen = screen_init();
+    session.screenshots = screenshot_start(shot_scale);
+
+    // notes the main chunk plays wait in the queue of the mixer until the device opens
+    Audio* audio = NULL;
+    if (audio_mode > 0 || (audio_mode == 0 && !headless)) {
+        audio = options.audio = audio_new();
+    }
+
+    // the window and the cart don't depend on each other until the first frame: the cart
+    // gets built on a thread of its own while this one, which has to keep the window, opens it
+    CartLaunch launch = {filenames[0], screen, &options, NULL};
+    SDL_Thread* launcher = NULL;
+    Uint64 window_ticks = 0;
+    if (!headless) {
+        launcher = SDL_CreateThread(launch_cart, "ves-launch", &launch);
+
+        Uint64 window_start = SDL_GetPerformanceCounter();
+        screen_open_window(screen);
+        window_ticks = SDL_GetPerformanceCounter() - window_start;
+    }
+    if (audio != NULL) {
+        audio_start(audio);
+    }
+    if (launcher != NULL) {
+        SDL_WaitThread(launcher, NULL);
+    } else {
+        launch_cart(&launch);
+    }
+
+    Cart* cart = session.cart = launch.cart;
+    cart->screenshots = session.screenshots;
+    CartStartup startup = cart->startup; // of the first instance, --watch may replace it
+
+    if (loadstate_filename != NULL && !session_load_state(&session, loadstate_filename)) {
+        cart_free(cart);
+        screenshot_stop(session.screenshots);
+        screen_free(screen);
+        return 1;
+    }
+
+    if (gif_filename != NULL && (session.gif = gif_start(gif_filename)) == NULL) {
+        printf("! Couldn't write GIF %s\n", gif_filename);
+    }
 
-        // TODO: remove clear later since entire screen is redrawn anyways
-        SDL_SetRenderDrawColor(ves_screen->renderer, 0x00, 0x00, 0x00, 0x00);
-        SDL_RenderClear(ves_screen->renderer);
-        screen_blit(ves_screen);
-        SDL_RenderPresent(ves_screen->renderer);
+    session.rawvideo = rawvideo;
+
+    if (rewind_mb > 0 && (session.rewind = rewind_new((size_t) rewind_mb << 20, rewind_keyframe)) == NULL) {
+        printf("! Couldn't allocate %d MB for rewinding\n", rewind_mb);
+    }
+
+    if (watch) {
+        if ((session.watch = filewatch_new(filenames[0])) == NULL) {
+            printf("! Couldn't watch %s for changes\n", filenames[0]);
+        } else {
+            printf("Watch: reloading %s when it changes\n", filenames[0]);
+        }
+    }
+
+    if (stream_address != NULL) {
+        if ((session.stream = framestream_start(stream_address)) == NULL) {
+            printf("! Couldn't listen on %s\n", stream_address);
+        } else {
+            printf("Stream: listening on %s\n", stream_address);
+        }
+    }
+
+    Uint64 start = SDL_GetPerformanceCounter();
+
+    if (headless) {
+        session_run_headless(&session);
+    } else if (pipelined) {
+        session_run_pipelined(&session);
+    } else {
+        session_run_serial(&session);
+    }
+
+    double seconds = (double) (SDL_GetPerformanceCounter() - start) / SDL_GetPerformanceFrequency();
+
+    if (replay != NULL) {
+        printf("Replay: %lu frames in %.3f s, %.3f ms per frame, %.0f frames/s\n",
+            replay->frames, seconds, seconds * 1000 / replay->frames, replay->frames / seconds);
     }
 
-    screen_free(ves_screen);
+    if (!headless && session.presented > 0) {
+        double ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+        printf("Frames (%s): %lu run, %lu presented in %.3f s, %.0f frames/s, latency %.2f ms average, %.2f ms max\n",
+            pipelined ? "pipelined" : "serial", session.stepped, session.presented, seconds, session.stepped / seconds,
+            session.latency_ticks * ms_per_tick / session.presented, session.latency_max * ms_per_tick);
+    }
+
+    if (alloc_test) {
+        printf("Allocations: %lu of %lu frames allocated after a warm-up of %d frames\n",
+            session.alloc_frames, session.stepped > ALLOC_TEST_WARMUP_FRAMES ? session.stepped - ALLOC_TEST_WARMUP_FRAMES : 0,
+            ALLOC_TEST_WARMUP_FRAMES);
+    }
+
+    startup_report(&session, &startup, launched, window_ticks, launcher != NULL);
+
+    if (fps > 0) {
+        printf("Pacing: %u frames/s, %lu frames skipped to catch up, slowed down %lu times\n", fps, session.skipped, session.slowdowns);
+    }
+
+    if (savestate_filename != NULL) {
+        session_save_state(&session, savestate_filename);
+    }
+
+    if (profiler != NULL && !profiler_write(profiler, profile_filename)) {
+        printf("! Couldn't write profile %s\n", profile_filename);
+    }
+
+    unsigned long golden_failures = golden_close(golden);
+
+    replay_close(replay);
+    replay_close(record);
+    gif_stop(session.gif);
+    rewind_free(session.rewind);
+    rawvideo_stop(rawvideo);
+    framestream_stop(session.stream);
+    filewatch_free(session.watch);
+    audio_free(audio);
+
+    cart_free(session.cart);
+    profiler_free(profiler);
+    screenshot_stop(session.screenshots);
+    screen_free(screen);
 
-    lua_close(L);
     atexit(SDL_Quit); // it is not wise to call this from a library or other dynamically loaded code
 
-	return 0;
-}
\ No newline at end of file
+	return golden_failures > 0 || session.alloc_frames > 0 ? 1 : 0;
+}
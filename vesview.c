@@ -0,0 +1,124 @@
+// Viewer for the frames streamed by vesemu --stream <address>
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+
+#include "SDL.h"
+
+#include "framecodec.h"
+#include "framestream.h"
+#include "nblscreen.h"
+
+#define VIEW_POLL_MS 16
+
+static int view_read(int fd, Uint8* data, size_t size) {
+    while (size > 0) {
+        ssize_t got = read(fd, data, size);
+        if (got < 0 && errno == EINTR) {
+            continue;
+        }
+        if (got <= 0) {
+            return 0;
+        }
+        data += got;
+        size -= got;
+    }
+
+    return 1;
+}
+
+// Reads one frame into screen, returns 0 when the stream ended or is corrupt
+static int view_read_frame(int fd, Screen* screen, Uint8* payload) {
+    Uint8 header[FRAMESTREAM_HEADER_SIZE];
+
+    if (!view_read(fd, header, FRAMESTREAM_HEADER_SIZE)) {
+        return 0;
+    }
+
+    size_t size = header[0] | (header[1] << 8) | (header[2] << 16);
+    Uint8 flags = header[3];
+    if (size > FRAMESTREAM_PALETTE_SIZE + FRAMECODEC_MAX_SIZE(SCREEN_BUFFER_SIZE) || !view_read(fd, payload, size)) {
+        return 0;
+    }
+
+    Uint8* data = payload;
+    if (flags & FRAMESTREAM_PALETTE) {
+        if (size < FRAMESTREAM_PALETTE_SIZE) {
+            return 0;
+        }
+        for (int i = 0; i < 16; i++) {
+            screen->colors[i].r = data[i * 3];
+            screen->colors[i].g = data[i * 3 + 1];
+            screen->colors[i].b = data[i * 3 + 2];
+        }
+        data += FRAMESTREAM_PALETTE_SIZE;
+        size -= FRAMESTREAM_PALETTE_SIZE;
+    }
+
+    return framecodec_decode(data, size, screen->pixels, SCREEN_BUFFER_SIZE);
+}
+
+int main(int argc, char** argv) {
+    if (argc != 2) {
+        printf("Usage: %s <socket path | tcp:port>\n", argv[0]);
+        return 1;
+    }
+
+    int fd = framestream_connect(argv[1]);
+    if (fd < 0) {
+        printf("! Couldn't connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    Screen* screen = screen_init();
+    memset(screen->colors, 0, sizeof(screen->colors)); // the stream starts with the real palette
+    screen_open_window(screen);
+
+    Uint8* payload = malloc(FRAMESTREAM_PALETTE_SIZE + FRAMECODEC_MAX_SIZE(SCREEN_BUFFER_SIZE));
+    unsigned long frames = 0;
+    int quit = 0;
+    SDL_Event event;
+    struct pollfd pfd;
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+
+    while (!quit) {
+        while (SDL_PollEvent(&event)) {
+            if (event.type == SDL_QUIT) {
+                quit = 1;
+            }
+        }
+
+        // drain every frame that arrived, only the newest is shown
+        int received = 0;
+        int timeout = VIEW_POLL_MS;
+        while (!quit && poll(&pfd, 1, timeout) > 0) {
+            if (!view_read_frame(fd, screen, payload)) {
+                printf("Stream ended after %lu frames\n", frames);
+                quit = 1;
+                break;
+            }
+            frames++;
+            received = 1;
+            timeout = 0;
+        }
+
+        if (received) {
+            screen_blit(screen);
+            SDL_RenderPresent(screen->renderer);
+        }
+    }
+
+    free(payload);
+    close(fd);
+    screen_free(screen);
+
+    atexit(SDL_Quit);
+
+    return 0;
+}
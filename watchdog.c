@@ -0,0 +1,86 @@
+#include "watchdog.h"
+
+#include <stdio.h>
+#include <string.h>
+
+void watchdog_init(Watchdog* wd) {
+    memset(wd, 0, sizeof(Watchdog));
+    wd->mode = WATCHDOG_ABORT;
+    wd->time_budget_ms = WATCHDOG_DEFAULT_TIME_MS;
+}
+
+static void watchdog_report(lua_State* L, Watchdog* wd, const char* verdict) {
+    luaL_traceback(L, L, NULL, 0);
+    printf("! Watchdog: %s went over budget (%lu instructions, %u ms), %s\n%s\n",
+        wd->callback, wd->insns,
+        (unsigned int) ((SDL_GetPerformanceCounter() - wd->start) * 1000 / SDL_GetPerformanceFrequency()),
+        verdict, lua_tostring(L, -1));
+    lua_pop(L, 1);
+}
+
+void watchdog_check(Watchdog* wd, lua_State* L, unsigned int insns) {
+    if (wd->callback == NULL) {
+        return;
+    }
+
+    // once tripped, keep raising so a cart can't swallow the error with pcall and keep looping
+    if (wd->tripped) {
+        luaL_error(L, "watchdog: %s aborted", wd->callback);
+        return;
+    }
+
+    wd->insns += insns;
+
+    // elapsed time and instructions as a multiple of the budget, whichever is worse
+    unsigned long usage = 0;
+    unsigned long limit = 1;
+    if (wd->time_budget_ms) {
+        unsigned long elapsed_ms = (SDL_GetPerformanceCounter() - wd->start) * 1000 / SDL_GetPerformanceFrequency();
+        if (elapsed_ms * limit > usage * wd->time_budget_ms) {
+            usage = elapsed_ms;
+            limit = wd->time_budget_ms;
+        }
+    }
+    if (wd->insn_budget && wd->insns * limit > usage * wd->insn_budget) {
+        usage = wd->insns;
+        limit = wd->insn_budget;
+    }
+
+    if (usage <= limit) {
+        return;
+    }
+
+    if (wd->mode == WATCHDOG_DEGRADE && usage <= limit * WATCHDOG_HARD_FACTOR) {
+        if (!wd->reported) {
+            wd->reported = 1;
+            wd->overruns++;
+            watchdog_report(L, wd, "continuing in degraded mode");
+        }
+        return;
+    }
+
+    if (!wd->reported) {
+        wd->overruns++;
+    }
+    wd->reported = 1;
+    wd->tripped = 1;
+    watchdog_report(L, wd, "aborting");
+    luaL_error(L, "watchdog: %s aborted", wd->callback);
+}
+
+int watchdog_enabled(const Watchdog* wd) {
+    return wd->insn_budget != 0 || wd->time_budget_ms != 0;
+}
+
+void watchdog_arm(Watchdog* wd, const char* callback) {
+    wd->callback = callback;
+    wd->insns = 0;
+    wd->reported = 0;
+    wd->tripped = 0;
+    wd->start = SDL_GetPerformanceCounter();
+}
+
+int watchdog_disarm(Watchdog* wd) {
+    wd->callback = NULL;
+    return wd->tripped;
+}
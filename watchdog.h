@@ -0,0 +1,47 @@
+#ifndef WATCHDOG_H
+#define WATCHDOG_H
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "SDL.h"
+
+#define WATCHDOG_HOOK_INTERVAL 1000 // Lua instructions between two budget checks
+#define WATCHDOG_HARD_FACTOR 10 // degraded carts are still aborted past this multiple of the budget
+#define WATCHDOG_DEFAULT_TIME_MS 1000
+
+typedef enum WatchdogMode {
+    WATCHDOG_ABORT, // abort the callback as soon as it goes over budget
+    WATCHDOG_DEGRADE // report once, let the callback finish unless it hits the hard limit
+} WatchdogMode;
+
+typedef struct Watchdog {
+    WatchdogMode mode;
+    unsigned long insn_budget; // 0 means unlimited
+    unsigned int time_budget_ms; // 0 means unlimited
+
+    // state of the callback currently running
+    const char* callback;
+    unsigned long insns;
+    Uint64 start;
+    int reported;
+    int tripped;
+
+    unsigned long overruns; // number of callbacks that went over budget so far
+} Watchdog;
+
+void watchdog_init(Watchdog* wd);
+
+// 0 if neither budget is set, the count hook isn't needed then
+int watchdog_enabled(const Watchdog* wd);
+
+// Called from the count hook of L every insns instructions, raises an error to abort the callback
+void watchdog_check(Watchdog* wd, lua_State* L, unsigned int insns);
+
+// Call before and after running a Lua callback.
+// watchdog_disarm returns 1 if the callback was aborted by the watchdog.
+void watchdog_arm(Watchdog* wd, const char* callback);
+
+int watchdog_disarm(Watchdog* wd);
+
+#endif